@@ -0,0 +1,4 @@
+#!/bin/bash
+set -e
+gcc -O2 -o tests/bench_jsb tests/bench_jsb.c
+tests/bench_jsb
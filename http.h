@@ -18,6 +18,25 @@
     ds_da_free(&headers);
     // POST url with data
     http(url, &response, .method = HTTP_POST, .body="data");
+    // Keep the connection alive across requests
+    HttpClient client = {0};
+    http_client(&client, url, &response);
+    http_client(&client, url, &response, .method = HTTP_POST, .body="data");
+    // Send requests concurrently, responses[i] is the response to requests[i]
+    HttpRequest requests[] = {{.url = url1}, {.url = url2, .method = HTTP_POST, .body = "data"}};
+    HttpResponse responses[2] = {0};
+    http_batch(&client, requests, 2, responses);
+    http_client_free(&client);
+    // Handle an NDJSON body record by record as it arrives, without buffering it
+    HttpLines lines = {.on_line = on_record, .ctx = &state};
+    HttpResponse stream = {.on_chunk = http_lines_write, .chunk_ctx = &lines};
+    http(url, &stream);
+    http_lines_finish(&lines);
+    // Share DNS results and TLS sessions between the clients of all threads
+    HttpShare share = {0};
+    http_share_init(&share, false);
+    http_share_resolve(&share, "api.internal:443:10.0.0.7");
+    http_share_default(&share); // used by clients without their own .share
 ```
  */
 
@@ -30,7 +49,30 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <ctype.h>
 #include "ds.h"
+#if !defined(HTTP_NO_THREADS) && !defined(_WIN32)
+#include <pthread.h>
+#define HTTP_THREADS
+#endif
+
+#ifndef HTTP_MAX_CONCURRENT
+#define HTTP_MAX_CONCURRENT 16
+#endif
+
+// Most of a body reserved from Content-Length before any of it arrives. The header is trusted up to this size:
+// beyond it the body is reserved in steps as bytes arrive, so a server announcing more than it sends costs little
+#ifndef HTTP_MAX_PREALLOC
+#define HTTP_MAX_PREALLOC (4 << 20)
+#endif
+
+#ifndef HTTP_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define HTTP_THREAD_LOCAL __declspec(thread)
+#else
+#define HTTP_THREAD_LOCAL _Thread_local
+#endif
+#endif
 
 typedef enum {
     HTTP_GET,
@@ -44,25 +86,180 @@ typedef enum {
 
 ds_da_declare(HttpHeaders, const char *);
 
+/**
+ * Receives a chunk of the response body.
+ * Returns 0 on success, -1 to abort the transfer (the request then fails with CURLE_WRITE_ERROR).
+ */
+typedef int (*HttpChunkFn)(void *ctx, const char *data, size_t len);
+
 typedef struct {
     long status_code;
     DsStringBuilder body;
+    CURLcode result;  // transfer result
+    size_t size_hint; // initial body capacity, the body is also reserved from Content-Length
+    size_t expected;  // body capacity announced by Content-Length, 0 if unknown
+    // Optional consumer: body chunks are passed to it as they arrive instead of being kept in body
+    HttpChunkFn on_chunk;
+    void *chunk_ctx;
 } HttpResponse;
 
+/**
+ * Receives one line of an NDJSON body, without its line terminator. line is not NUL-terminated.
+ * Returns 0 on success, -1 to abort the transfer.
+ */
+typedef int (*HttpLineFn)(void *ctx, const char *line, size_t len);
+
+/**
+ * NDJSON splitter, set http_lines_write as on_chunk with the HttpLines as chunk_ctx.
+ * Lines contained in a chunk are passed without copy, only a line split across chunks is buffered.
+ * Empty lines are skipped.
+ */
+typedef struct {
+    HttpLineFn on_line;
+    void *ctx;
+    DsStringBuilder partial; // start of a line split across chunks
+} HttpLines;
+
 typedef struct {
     HttpMethod method;
     HttpHeaders *headers;
     const char *body;
 } HttpRequestOpts;
 
+typedef enum {
+    HTTP_VERSION_DEFAULT,          // libcurl's default
+    HTTP_VERSION_1_1,
+    HTTP_VERSION_2,                // HTTP/2 over TLS (negotiated with ALPN), HTTP/1.1 for http:// URLs
+    HTTP_VERSION_2_PRIOR_KNOWLEDGE // HTTP/2 without negotiation, including cleartext h2c to local services
+} HttpVersion;
+
+/**
+ * Client counters, updated as transfers complete. They cover all hosts together:
+ * libcurl reports the connections a transfer opened, not which connection or host it used.
+ */
+typedef struct {
+    long requests;      // completed transfers
+    long connects;      // new connections opened by them, the others reused one
+    long http2;         // transfers done over HTTP/2
+    int peak_in_flight; // most batch transfers in flight at once, at most max_concurrent;
+                        // they are streams of one connection only with HTTP/2 and a single connection per host
+} HttpStats;
+
+/**
+ * Caches shared by the handles of several clients and threads, see http_share_init.
+ */
+typedef struct {
+    CURLSH *share;
+    struct curl_slist *resolve; // pre-populated DNS entries, set on every request
+#ifdef HTTP_THREADS
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+#endif
+} HttpShare;
+
+/**
+ * Reusable client: the easy handle is kept between requests, and with it
+ * the open connections, the DNS cache and the TLS sessions.
+ * A client must only be used by one thread at a time, zero-initialize it before the first request.
+ */
+typedef struct {
+    HttpShare *share;   // optional, defaults to the one set with http_share_default
+    CURL *curl;
+    CURLM *multi;       // batch transfers share its connections
+    CURL **handles;     // batch easy handles, reused across batches
+    size_t handle_count;
+    int max_concurrent; // batch transfers in flight, 0 uses HTTP_MAX_CONCURRENT
+    // With HTTP/2, concurrent batch transfers to a host wait for and multiplex over a single connection
+    HttpVersion version;
+    int max_host_connections; // batch connections per host, 0 for no limit
+    int max_streams;          // HTTP/2 streams per connection, 0 uses libcurl's default (100)
+    HttpStats stats;
+} HttpClient;
+
+/**
+ * A request of a batch.
+ */
+typedef struct {
+    const char *url;
+    HttpMethod method;
+    HttpHeaders *headers;
+    const char *body;
+} HttpRequest;
+
+/**
+ * Called by http_batch_cb as soon as requests[index] completes, in completion order.
+ * response->result holds the transfer result.
+ */
+typedef void (*HttpDoneFn)(size_t index, HttpResponse *response, void *ctx);
+
 #define http_free_response(resp) ds_da_free(&(resp)->body)
 #define http_init() curl_global_init(CURL_GLOBAL_DEFAULT)
-#define http_cleanup() curl_global_cleanup()
+// Free the calling thread's default client and clean up libcurl, other threads must be done with their requests
+#define http_cleanup()             \
+    do {                           \
+        http_thread_client_free(); \
+        curl_global_cleanup();     \
+    } while (0)
+
+/**
+ * Close the client connections and free its handle, the client can be reused afterwards.
+ */
+void http_client_free(HttpClient *client);
+/**
+ * The calling thread's default client, used by http_request and the http() macros.
+ * With pthreads it is freed when the thread exits.
+ * Returns NULL if its handle could not be created.
+ */
+HttpClient *http_thread_client(void);
+/**
+ * Free the calling thread's default client now, e.g. to close its connections.
+ * Without pthreads (HTTP_NO_THREADS or Windows) call it before a thread exits.
+ */
+void http_thread_client_free(void);
+
+/**
+ * Create a share of the DNS cache and the TLS sessions, locked with mutexes so that every thread can use it.
+ * With connections, idle connections are shared too: libcurl does not support using a shared connection cache
+ * from concurrent threads, only enable it when the clients using the share never perform at the same time.
+ * Returns CURLE_OK on success.
+ */
+CURLcode http_share_init(HttpShare *share, bool connections);
+/**
+ * Add a DNS entry in the curl "host:port:address[,address]" format, before the share is used.
+ * Requests of the clients using the share resolve host from it instead of querying DNS.
+ * Returns CURLE_OK on success.
+ */
+CURLcode http_share_resolve(HttpShare *share, const char *entry);
+/**
+ * Set the share used by clients without one, including the thread default clients. NULL unsets it.
+ * Call it before sending requests from other threads.
+ */
+void http_share_default(HttpShare *share);
+/**
+ * Free the share once no client uses it anymore: a client lets go of it on its next request
+ * without the share, or when it is freed (see http_client_free and http_thread_client_free).
+ * Returns CURLSHE_OK on success, CURLSHE_IN_USE if a handle still uses it, then nothing is freed.
+ */
+CURLSHcode http_share_free(HttpShare *share);
 
+CURLcode http_client_request(HttpClient *client, const char *url, HttpMethod method, HttpHeaders *headers, const char *body, HttpResponse *response);
 CURLcode http_request(const char *url, HttpMethod method, HttpHeaders *headers, const char *body, HttpResponse *response);
+/**
+ * Send n requests concurrently, at most client->max_concurrent at a time, over the client's multi handle.
+ * responses[i] receives the response to requests[i].
+ * Returns CURLE_OK if every transfer succeeded, else the result of the first failed request.
+ */
+CURLcode http_batch(HttpClient *client, const HttpRequest *requests, size_t n, HttpResponse *responses);
+/**
+ * http_batch calling done for each request as soon as it completes.
+ * With responses NULL, the in-flight transfers use internal responses that are only valid during the callback,
+ * so memory does not grow with n.
+ */
+CURLcode http_batch_cb(HttpClient *client, const HttpRequest *requests, size_t n, HttpResponse *responses, HttpDoneFn done, void *ctx);
 
 #define http(url, response, ...) \
     http_request_opts(url, response, (HttpRequestOpts){__VA_ARGS__})
+#define http_client(client, url, response, ...) \
+    http_client_request_opts(client, url, response, (HttpRequestOpts){__VA_ARGS__})
 #define http_get(url, headers, response) http_request(url, HTTP_GET, headers, NULL, response)
 #define http_post(url, headers, body, response) http_request(url, HTTP_POST, headers, body, response)
 #define http_put(url, headers, body, response) http_request(url, HTTP_PUT, headers, body, response)
@@ -70,6 +267,17 @@ CURLcode http_request(const char *url, HttpMethod method, HttpHeaders *headers,
 #define http_delete(url, headers, response) http_request(url, HTTP_DELETE, headers, NULL, response)
 #define http_reset_response(resp) (resp)->body.count = 0
 
+/**
+ * HttpChunkFn splitting the body into lines for an HttpLines.
+ * Returns 0 on success, -1 on failure.
+ */
+int http_lines_write(void *ctx, const char *data, size_t len);
+/**
+ * Pass the last line if the body did not end with a new line, and free the splitter buffer.
+ * Returns 0 on success, -1 on failure.
+ */
+int http_lines_finish(HttpLines *lines);
+
 static inline CURLcode http_set_method(CURL *curl, HttpMethod method) {
     switch (method) {
     case HTTP_GET:
@@ -98,20 +306,317 @@ static inline CURLcode http_set_headers(CURL *curl, HttpHeaders *headers, struct
     return res;
 }
 
+/**
+ * Grow the body to exactly capacity bytes, no-op if it is already large enough.
+ */
+static void http_reserve_body(DsStringBuilder *sb, size_t capacity) {
+    if (capacity <= sb->capacity) return;
+    char *items = DS_REALLOC(sb->items, capacity);
+    // On failure the body keeps growing chunk by chunk
+    if (!items) return;
+    sb->items = items;
+    sb->capacity = capacity;
+}
+
 static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t total = size * nmemb;
-    DsStringBuilder *sb = (DsStringBuilder *)userp;
+    HttpResponse *response = (HttpResponse *)userp;
+    if (response->on_chunk) {
+        // Anything but total makes curl abort with CURLE_WRITE_ERROR
+        return response->on_chunk(response->chunk_ctx, contents, total) ? 0 : total;
+    }
+    DsStringBuilder *sb = &response->body;
+    if (sb->count + total + 1 > sb->capacity && response->expected > sb->capacity) {
+        // Past the preallocated part, grow with the received bytes up to the announced size
+        size_t capacity = sb->capacity * 2;
+        if (capacity < sb->count + total + 1) capacity = sb->count + total + 1;
+        if (capacity > response->expected) capacity = response->expected;
+        http_reserve_body(sb, capacity);
+    }
+    // The body is NUL-terminated once complete, see http_finish_body
     ds_da_append_many(sb, (char *)contents, total);
-    ds_sb_append(sb);
     return total;
 }
 
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t total = size * nitems;
+    HttpResponse *response = (HttpResponse *)userp;
+    static const char name[] = "content-length:";
+    size_t n = sizeof(name) - 1;
+    if (response->on_chunk || total <= n) return total;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)buffer[i]) != name[i]) return total;
+    }
+    size_t i = n, len = 0;
+    while (i < total && buffer[i] == ' ')
+        i++;
+    if (i == total || !isdigit((unsigned char)buffer[i])) return total;
+    for (; i < total && isdigit((unsigned char)buffer[i]); i++) {
+        if (len > (SIZE_MAX - 10) / 10) return total;
+        len = len * 10 + (buffer[i] - '0');
+    }
+    if (response->body.count + len + 1 < len) return total;
+    // Room for the body and its terminator, only the first HTTP_MAX_PREALLOC bytes before they arrive
+    response->expected = response->body.count + len + 1;
+    http_reserve_body(&response->body, response->body.count + (len < HTTP_MAX_PREALLOC ? len : HTTP_MAX_PREALLOC) + 1);
+    return total;
+}
+
+/**
+ * NUL-terminate a buffered body once the transfer is over.
+ */
+static void http_finish_body(HttpResponse *response) {
+    DsStringBuilder *sb = &response->body;
+    if (response->on_chunk || !sb->items) return;
+    ds_da_reserve(sb, sb->count + 1);
+    sb->items[sb->count] = '\0';
+}
+
+static int http_lines_emit(HttpLines *lines, const char *line, size_t len) {
+    if (len && line[len - 1] == '\r') len--;
+    if (!len) return 0;
+    return lines->on_line(lines->ctx, line, len);
+}
+
+int http_lines_write(void *ctx, const char *data, size_t len) {
+    HttpLines *lines = (HttpLines *)ctx;
+    const char *end = data + len;
+    const char *nl;
+    while ((nl = memchr(data, '\n', end - data))) {
+        int err;
+        if (lines->partial.count) {
+            // Complete the line started in a previous chunk
+            ds_da_append_many(&lines->partial, data, (size_t)(nl - data));
+            err = http_lines_emit(lines, lines->partial.items, lines->partial.count);
+            lines->partial.count = 0;
+        } else {
+            err = http_lines_emit(lines, data, nl - data);
+        }
+        if (err) return -1;
+        data = nl + 1;
+    }
+    ds_da_append_many(&lines->partial, data, (size_t)(end - data));
+    return 0;
+}
+
+int http_lines_finish(HttpLines *lines) {
+    int err = lines->partial.count ? http_lines_emit(lines, lines->partial.items, lines->partial.count) : 0;
+    ds_da_free(&lines->partial);
+    return err;
+}
+
 static inline CURLcode http_request_opts(const char *url, HttpResponse *response, HttpRequestOpts opts) {
     return http_request(url, opts.method, opts.headers, opts.body, response);
 }
 
+static inline CURLcode http_client_request_opts(HttpClient *client, const char *url, HttpResponse *response, HttpRequestOpts opts) {
+    return http_client_request(client, url, opts.method, opts.headers, opts.body, response);
+}
+
+void http_client_free(HttpClient *client) {
+    if (client->curl) curl_easy_cleanup(client->curl);
+    client->curl = NULL;
+    for (size_t i = 0; i < client->handle_count; i++) {
+        curl_easy_cleanup(client->handles[i]);
+    }
+    free(client->handles);
+    client->handles = NULL;
+    client->handle_count = 0;
+    if (client->multi) curl_multi_cleanup(client->multi);
+    client->multi = NULL;
+}
+
+static HttpShare *http_default_share;
+
+#ifdef HTTP_THREADS
+// The thread default clients are freed by the key destructor when their thread exits
+static pthread_key_t http_client_key;
+static pthread_once_t http_client_once = PTHREAD_ONCE_INIT;
+
+static void http_client_exit(void *client) {
+    http_client_free((HttpClient *)client);
+    free(client);
+}
+
+static void http_client_key_init(void) {
+    pthread_key_create(&http_client_key, http_client_exit);
+}
+#else
+static HTTP_THREAD_LOCAL HttpClient http_default_client;
+#endif
+
+#ifdef HTTP_THREADS
+static void http_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)handle;
+    (void)access;
+    HttpShare *share = (HttpShare *)userptr;
+    pthread_mutex_lock(&share->locks[data]);
+}
+
+static void http_share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle;
+    HttpShare *share = (HttpShare *)userptr;
+    pthread_mutex_unlock(&share->locks[data]);
+}
+#endif
+
+CURLcode http_share_init(HttpShare *share, bool connections) {
+    *share = (HttpShare){0};
+    share->share = curl_share_init();
+    if (!share->share) return CURLE_FAILED_INIT;
+    CURLSHcode res = CURLSHE_OK;
+#ifdef HTTP_THREADS
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share->locks[i], NULL);
+    }
+    res = curl_share_setopt(share->share, CURLSHOPT_LOCKFUNC, http_share_lock);
+    if (!res) res = curl_share_setopt(share->share, CURLSHOPT_UNLOCKFUNC, http_share_unlock);
+    if (!res) res = curl_share_setopt(share->share, CURLSHOPT_USERDATA, share);
+#endif
+    if (!res) res = curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    if (!res) res = curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (!res && connections) res = curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    if (res) {
+        http_share_free(share);
+        return CURLE_FAILED_INIT;
+    }
+    return CURLE_OK;
+}
+
+CURLcode http_share_resolve(HttpShare *share, const char *entry) {
+    struct curl_slist *list = curl_slist_append(share->resolve, entry);
+    if (!list) return CURLE_OUT_OF_MEMORY;
+    share->resolve = list;
+    return CURLE_OK;
+}
+
+void http_share_default(HttpShare *share) {
+    http_default_share = share;
+}
+
+CURLSHcode http_share_free(HttpShare *share) {
+    if (!share->share) return CURLSHE_OK;
+    // Still used by a handle: keep it alive rather than pull the locks from under it
+    CURLSHcode res = curl_share_cleanup(share->share);
+    if (res != CURLSHE_OK) return res;
+    share->share = NULL;
+    curl_slist_free_all(share->resolve);
+    share->resolve = NULL;
+#ifdef HTTP_THREADS
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&share->locks[i]);
+    }
+#endif
+    return CURLSHE_OK;
+}
+
+HttpClient *http_thread_client(void) {
+#ifdef HTTP_THREADS
+    pthread_once(&http_client_once, http_client_key_init);
+    HttpClient *client = (HttpClient *)pthread_getspecific(http_client_key);
+    if (!client) {
+        client = (HttpClient *)calloc(1, sizeof(*client));
+        if (!client) return NULL;
+        if (pthread_setspecific(http_client_key, client)) {
+            free(client);
+            return NULL;
+        }
+    }
+#else
+    HttpClient *client = &http_default_client;
+#endif
+    if (!client->curl) {
+        client->curl = curl_easy_init();
+        if (!client->curl) return NULL;
+    }
+    return client;
+}
+
+void http_thread_client_free(void) {
+#ifdef HTTP_THREADS
+    pthread_once(&http_client_once, http_client_key_init);
+    HttpClient *client = (HttpClient *)pthread_getspecific(http_client_key);
+    if (!client) return;
+    pthread_setspecific(http_client_key, NULL);
+    http_client_exit(client);
+#else
+    http_client_free(&http_default_client);
+#endif
+}
+
 /**
- * Sends an HTTP request.
+ * Add a completed transfer to the client stats.
+ */
+static void http_count(HttpClient *client, CURL *curl) {
+    long connects = 0, version = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+    client->stats.requests++;
+    client->stats.connects += connects;
+    if (version == CURL_HTTP_VERSION_2_0) client->stats.http2++;
+}
+
+/**
+ * Set the options of a request on a reused handle.
+ * The caller frees *header_list once the transfer is done.
+ */
+static CURLcode http_setup(HttpClient *client, CURL *curl, const char *url, HttpMethod method, HttpHeaders *headers,
+                           const char *body, HttpResponse *response, struct curl_slist **header_list) {
+    // Drop the options of the previous request, connections and caches are kept
+    curl_easy_reset(curl);
+    CURLcode res = curl_easy_setopt(curl, CURLOPT_URL, url);
+    if (res) return res;
+    // curl_easy_reset keeps the share, set it on every request so that a handle lets go of an unset one
+    HttpShare *share = client->share ? client->share : http_default_share;
+    res = curl_easy_setopt(curl, CURLOPT_SHARE, share ? share->share : NULL);
+    if (res) return res;
+    if (share && share->resolve) {
+        res = curl_easy_setopt(curl, CURLOPT_RESOLVE, share->resolve);
+        if (res) return res;
+    }
+    if (client->version != HTTP_VERSION_DEFAULT) {
+        static const long versions[] = {
+            [HTTP_VERSION_1_1] = CURL_HTTP_VERSION_1_1,
+            [HTTP_VERSION_2] = CURL_HTTP_VERSION_2TLS,
+            [HTTP_VERSION_2_PRIOR_KNOWLEDGE] = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE,
+        };
+        res = curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, versions[client->version]);
+        if (res) return res;
+        // Wait for a connection that can multiplex rather than open a new one
+        if (client->version != HTTP_VERSION_1_1) {
+            res = curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+            if (res) return res;
+        }
+    }
+    res = http_set_method(curl, method);
+    if (res) return res;
+    if (headers) {
+        res = http_set_headers(curl, headers, header_list);
+        if (res) return res;
+    }
+    if (body) {
+        res = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+        if (res) return res;
+    }
+    response->expected = 0;
+    if (!response->on_chunk && response->size_hint) {
+        http_reserve_body(&response->body, response->body.count + response->size_hint);
+    }
+    // A HEAD response announces the length of a body it does not send
+    if (method != HTTP_HEAD) {
+        res = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+        if (res) return res;
+        res = curl_easy_setopt(curl, CURLOPT_HEADERDATA, response);
+        if (res) return res;
+    }
+    res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    if (res) return res;
+    return curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+}
+
+/**
+ * Sends an HTTP request with client, reusing its connections.
+ * @param client The client to send the request with.
  * @param url The URL to send the request to.
  * @param method The HTTP method to use.
  * @param headers The headers to include in the request, can be NULL.
@@ -119,37 +624,194 @@ static inline CURLcode http_request_opts(const char *url, HttpResponse *response
  * @param response The response object to populate.
  * @return CURLcode indicating the result of the request.
  */
-CURLcode http_request(const char *url, HttpMethod method, HttpHeaders *headers, const char *body, HttpResponse *response) {
-    CURL *curl;
+CURLcode http_client_request(HttpClient *client, const char *url, HttpMethod method, HttpHeaders *headers, const char *body, HttpResponse *response) {
     struct curl_slist *header_list = NULL;
     CURLcode res = CURLE_FAILED_INIT;
 
-    curl = curl_easy_init();
+    if (!client->curl) client->curl = curl_easy_init();
+    CURL *curl = client->curl;
     if (!curl) goto cleanup;
-    res = curl_easy_setopt(curl, CURLOPT_URL, url);
-    if (res) goto cleanup;
-    res = http_set_method(curl, method);
-    if (res) goto cleanup;
-    if (headers) {
-        res = http_set_headers(curl, headers, &header_list);
-        if (res) goto cleanup;
-    }
-    if (body) {
-        res = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
-        if (res) goto cleanup;
-    }
-
-    res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    if (res) goto cleanup;
-    res = curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response->body);
+    res = http_setup(client, curl, url, method, headers, body, response, &header_list);
     if (res) goto cleanup;
 
     res = curl_easy_perform(curl);
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response->status_code);
+    http_count(client, curl);
+    http_finish_body(response);
 cleanup:
     if (header_list) curl_slist_free_all(header_list);
-    if (curl) curl_easy_cleanup(curl);
+    response->result = res;
     return res;
 }
 
+typedef struct {
+    CURL *curl;
+    size_t index;
+    bool busy;
+    struct curl_slist *header_list;
+    HttpResponse response; // used when the caller passes no responses
+} HttpBatchSlot;
+
+typedef struct {
+    HttpClient *client;
+    const HttpRequest *requests;
+    size_t n;
+    HttpResponse *responses;
+    HttpDoneFn done;
+    void *ctx;
+    size_t next;        // next request to start
+    size_t failed;      // lowest failed index, n if none
+    CURLcode result;    // its result
+} HttpBatch;
+
+static void http_batch_done(HttpBatch *b, size_t index, HttpResponse *response, CURLcode res) {
+    response->result = res;
+    if (res != CURLE_OK && index < b->failed) {
+        b->failed = index;
+        b->result = res;
+    }
+    if (b->done) b->done(index, response, b->ctx);
+}
+
+/**
+ * Start the next pending request on slot, requests whose options can't be set complete right away.
+ * Returns 0 if a transfer was added, -1 if no request is left.
+ */
+static int http_batch_start(HttpBatch *b, HttpBatchSlot *slot) {
+    while (b->next < b->n) {
+        size_t index = b->next++;
+        const HttpRequest *req = &b->requests[index];
+        HttpResponse *response = b->responses ? &b->responses[index] : &slot->response;
+        if (!b->responses) http_reset_response(response);
+        response->status_code = 0;
+        slot->index = index;
+        CURLcode res = http_setup(b->client, slot->curl, req->url, req->method, req->headers, req->body, response,
+                                  &slot->header_list);
+        if (!res) res = curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, slot);
+        if (!res && curl_multi_add_handle(b->client->multi, slot->curl) != CURLM_OK) res = CURLE_FAILED_INIT;
+        if (!res) {
+            slot->busy = true;
+            return 0;
+        }
+        curl_slist_free_all(slot->header_list);
+        slot->header_list = NULL;
+        http_finish_body(response);
+        http_batch_done(b, index, response, res);
+    }
+    return -1;
+}
+
+/**
+ * Remove the completed transfer of slot from the multi handle and report it.
+ */
+static void http_batch_finish(HttpBatch *b, HttpBatchSlot *slot, CURLcode res) {
+    HttpResponse *response = b->responses ? &b->responses[slot->index] : &slot->response;
+    curl_multi_remove_handle(b->client->multi, slot->curl);
+    curl_easy_getinfo(slot->curl, CURLINFO_RESPONSE_CODE, &response->status_code);
+    http_count(b->client, slot->curl);
+    curl_slist_free_all(slot->header_list);
+    slot->header_list = NULL;
+    slot->busy = false;
+    http_finish_body(response);
+    http_batch_done(b, slot->index, response, res);
+}
+
+CURLcode http_batch_cb(HttpClient *client, const HttpRequest *requests, size_t n, HttpResponse *responses, HttpDoneFn done, void *ctx) {
+    if (n == 0) return CURLE_OK;
+    size_t cap = client->max_concurrent > 0 ? (size_t)client->max_concurrent : HTTP_MAX_CONCURRENT;
+    if (cap > n) cap = n;
+    if (!client->multi) client->multi = curl_multi_init();
+    if (!client->multi) return CURLE_FAILED_INIT;
+    // Set every option on each batch, the client settings may have changed since the previous one
+    long pipelining = client->version == HTTP_VERSION_1_1 ? CURLPIPE_NOTHING : CURLPIPE_MULTIPLEX;
+    curl_multi_setopt(client->multi, CURLMOPT_PIPELINING, pipelining);
+    curl_multi_setopt(client->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)client->max_host_connections);
+#if defined(LIBCURL_VERSION_NUM) && LIBCURL_VERSION_NUM >= 0x074300
+    long streams = client->max_streams > 0 ? client->max_streams : 100;
+    curl_multi_setopt(client->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, streams);
+#endif
+    if (client->handle_count < cap) {
+        CURL **handles = realloc(client->handles, cap * sizeof(*handles));
+        if (!handles) return CURLE_OUT_OF_MEMORY;
+        client->handles = handles;
+        while (client->handle_count < cap) {
+            CURL *curl = curl_easy_init();
+            if (!curl) return CURLE_FAILED_INIT;
+            client->handles[client->handle_count++] = curl;
+        }
+    }
+    HttpBatchSlot *slots = calloc(cap, sizeof(*slots));
+    if (!slots) return CURLE_OUT_OF_MEMORY;
+    HttpBatch b = {client, requests, n, responses, done, ctx, .failed = n, .result = CURLE_OK};
+
+    // Fill the slots, then start the next request in a slot as soon as its transfer completes
+    size_t active = 0;
+    for (size_t i = 0; i < cap; i++) {
+        slots[i].curl = client->handles[i];
+        if (http_batch_start(&b, &slots[i]) == 0) active++;
+    }
+    if ((int)active > client->stats.peak_in_flight) client->stats.peak_in_flight = (int)active;
+    CURLMcode mres = CURLM_OK;
+    while (active > 0) {
+        int running = 0;
+        mres = curl_multi_perform(client->multi, &running);
+        if (mres != CURLM_OK) break;
+        CURLMsg *msg;
+        int queued;
+        while ((msg = curl_multi_info_read(client->multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            HttpBatchSlot *slot = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&slot);
+            http_batch_finish(&b, slot, msg->data.result);
+            active--;
+            if (http_batch_start(&b, slot) == 0) active++;
+            if ((int)active > client->stats.peak_in_flight) client->stats.peak_in_flight = (int)active;
+        }
+        if (active == 0) break;
+#if defined(LIBCURL_VERSION_NUM) && LIBCURL_VERSION_NUM >= 0x074200
+        mres = curl_multi_poll(client->multi, NULL, 0, 1000, NULL);
+#else
+        // Before libcurl 7.66 curl_multi_wait returns at once when there is no socket to wait on yet
+        mres = curl_multi_wait(client->multi, NULL, 0, 1000, NULL);
+#endif
+        if (mres != CURLM_OK) break;
+    }
+    // The multi handle failed: abort the transfers in flight and fail the ones not started
+    if (mres != CURLM_OK) {
+        for (size_t i = 0; i < cap; i++) {
+            if (slots[i].busy) http_batch_finish(&b, &slots[i], CURLE_FAILED_INIT);
+        }
+        while (b.next < n) {
+            size_t index = b.next++;
+            HttpResponse *response = responses ? &responses[index] : &slots[0].response;
+            if (!responses) http_reset_response(response);
+            http_batch_done(&b, index, response, CURLE_FAILED_INIT);
+        }
+    }
+    for (size_t i = 0; i < cap; i++) {
+        http_free_response(&slots[i].response);
+    }
+    free(slots);
+    return b.result;
+}
+
+CURLcode http_batch(HttpClient *client, const HttpRequest *requests, size_t n, HttpResponse *responses) {
+    return http_batch_cb(client, requests, n, responses, NULL, NULL);
+}
+
+/**
+ * Sends an HTTP request with the calling thread's default client.
+ * @param url The URL to send the request to.
+ * @param method The HTTP method to use.
+ * @param headers The headers to include in the request, can be NULL.
+ * @param body The body of the request, can be NULL.
+ * @param response The response object to populate.
+ * @return CURLcode indicating the result of the request.
+ */
+CURLcode http_request(const char *url, HttpMethod method, HttpHeaders *headers, const char *body, HttpResponse *response) {
+    HttpClient *client = http_thread_client();
+    if (!client) return CURLE_FAILED_INIT;
+    return http_client_request(client, url, method, headers, body, response);
+}
+
 #endif // HTTP_H_
\ No newline at end of file
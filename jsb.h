@@ -56,9 +56,30 @@
 #define JSB_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#ifdef JSB_ZLIB
+#include <zlib.h>
+#endif
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#if !defined(JSB_NO_THREADS) && !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#define JSB_THREADS
+#endif
 
 #ifndef JSB_REALLOC
 #define JSB_REALLOC realloc
@@ -71,6 +92,41 @@
 #define JSB_MAX_NESTING 64
 #endif
 
+#ifndef JSB_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define JSB_THREAD_LOCAL __declspec(thread)
+#else
+#define JSB_THREAD_LOCAL _Thread_local
+#endif
+#endif
+
+#ifndef JSB_FLUSH_SIZE
+#define JSB_FLUSH_SIZE 65536
+#endif
+
+#ifndef JSB_GZIP_CHUNK
+#define JSB_GZIP_CHUNK 16384
+#endif
+
+#ifndef JSB_CHAIN_SEGMENT
+#define JSB_CHAIN_SEGMENT 65536
+#endif
+
+#ifndef JSB_POOL_SIZE
+#define JSB_POOL_SIZE 4
+#endif
+#ifndef JSB_POOL_MAX_CAPACITY
+#define JSB_POOL_MAX_CAPACITY (1 << 20)
+#endif
+
+#ifndef JSB_CACHE_SIZE
+#define JSB_CACHE_SIZE 256
+#endif
+
+#ifndef JSB_COUNT_FLUSH_SIZE
+#define JSB_COUNT_FLUSH_SIZE 4096
+#endif
+
 #define JSB_SMIN_CAPACITY 32
 
 typedef enum {
@@ -81,12 +137,35 @@ typedef enum {
     JSB_STATE_END
 } JsbState;
 
+typedef enum {
+    JSB_DATE_DAY,     // 2024-01-31
+    JSB_DATE_SECONDS, // 2024-01-31T12:34:56Z
+    JSB_DATE_MILLIS,  // 2024-01-31T12:34:56.789Z
+    JSB_DATE_MICROS   // 2024-01-31T12:34:56.789123Z
+} JsbDatePrecision;
+
+/**
+ * Sink callback: writes len bytes of output.
+ * Returns 0 on success, -1 on failure.
+ */
+typedef int (*JsbWriteFn)(void *ctx, const char *data, size_t len);
+
 struct jsb_string {
     char *items;
     size_t count;
     size_t capacity;
+    bool borrowed; // items is caller memory, it is never reallocated nor freed
+    bool can_grow; // a borrowed buffer moves to a JSB_REALLOC one on overflow
+    bool failed;   // an allocation failed or a fixed buffer overflowed
+    JsbWriteFn write; // optional sink, pending output is flushed to it instead of growing the buffer
+    void *write_ctx;
+    size_t flush_size; // pending bytes that trigger a flush
+    size_t flushed;    // bytes already written to the sink
+    bool hold;         // never flush while growing, the pending output is still rewritten in place
 };
 
+struct jsb_canon;
+
 typedef struct {
     struct jsb_string buffer;
     JsbState state[JSB_MAX_NESTING];
@@ -94,18 +173,262 @@ typedef struct {
     bool is_first;
     bool is_key;
     int pp;
+    bool ascii;  // escape non-ASCII characters as \uXXXX
+    bool ndjson; // newline terminated top-level objects/arrays, one after the other, pp is ignored
+    // Canonical output: keys sorted per object, no whitespace, shortest numbers (jsb_number ignores precision),
+    // hashed with jsb_hash. pp is ignored and a sink only receives complete top-level values.
+    bool canonical;
+    struct jsb_canon *canon; // canonical mode state, allocated on first use
 } Jsb;
 
-#define jsb_free(jsb)                      \
-    do {                                   \
-        if ((jsb)->buffer.items) {         \
-            JSB_FREE((jsb)->buffer.items); \
-            (jsb)->buffer.items = NULL;    \
-            (jsb)->buffer.count = 0;       \
-            (jsb)->buffer.capacity = 0;    \
-        }                                  \
+/**
+ * Pre-escaped object key: the quoted key followed by ": ".
+ * Build it once with JSB_KEY (literals) or jsb_key_init (runtime strings).
+ */
+typedef struct {
+    const char *str;
+    size_t len;
+} JsbKey;
+
+/**
+ * Declare a key from a string literal.
+ * The literal must be printable ASCII without quotes or backslashes, it is emitted as is.
+ * Example: `jsb_key_tok(&jsb, JSB_KEY("name"));`
+ */
+#define JSB_KEY(lit) ((JsbKey){"\"" lit "\": ", sizeof("\"" lit "\": ") - 1})
+
+/**
+ * Free the canonical mode state, used by jsb_free.
+ */
+void _jsb_free_canon(Jsb *jsb);
+
+#define jsb_free(jsb)                                         \
+    do {                                                      \
+        if ((jsb)->buffer.items && !(jsb)->buffer.borrowed) { \
+            JSB_FREE((jsb)->buffer.items);                    \
+        }                                                     \
+        _jsb_free_canon(jsb);                                 \
+        (jsb)->buffer.items = NULL;                           \
+        (jsb)->buffer.count = 0;                              \
+        (jsb)->buffer.capacity = 0;                           \
+        (jsb)->buffer.borrowed = false;                       \
+        (jsb)->buffer.failed = false;                         \
     } while (0)
 
+/**
+ * True if the output is incomplete: an allocation failed or a fixed buffer overflowed.
+ * It stays set, and every later call fails, until jsb_reset, jsb_free or jsb_init_buffer.
+ */
+#define jsb_failed(jsb) ((jsb)->buffer.failed)
+
+/**
+ * Write into a caller-provided buffer (e.g. stack or a socket send buffer) instead of a heap one.
+ * On overflow the failing call returns -1 and jsb_failed is set, unless can_grow is true:
+ * then the output is moved to a JSB_REALLOC buffer and building continues.
+ * jsb_free never releases the caller buffer.
+ */
+void jsb_init_buffer(Jsb *jsb, char *buffer, size_t capacity, bool can_grow);
+
+/**
+ * Stream the output to write(ctx, ...) instead of keeping it all in memory.
+ * Pending output is flushed once it reaches flush_size bytes (0 uses JSB_FLUSH_SIZE) and the buffer would grow,
+ * so a record longer than that is written in several parts. In ndjson mode it is also flushed at the end of
+ * each record once it reaches flush_size. Canonical output is only flushed after complete top-level values.
+ * Call jsb_flush after the last value, jsb_get only returns what is still pending.
+ * Example:
+```c
+    Jsb jsb = {.ndjson = true};
+    jsb_init_sink(&jsb, jsb_fwrite, stdout, 0);
+    for (size_t i = 0; i < count; ++i) {
+        _stringify_User(&jsb, &users[i]);
+    }
+    jsb_flush(&jsb);
+    jsb_free(&jsb);
+```
+ */
+void jsb_init_sink(Jsb *jsb, JsbWriteFn write, void *ctx, size_t flush_size);
+/**
+ * Write the pending output to the sink, does nothing without one.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_flush(Jsb *jsb);
+/**
+ * JsbWriteFn for a FILE *.
+ */
+int jsb_fwrite(void *file, const char *data, size_t len);
+
+/**
+ * Counting pass: the output is discarded as it is produced, in chunks of JSB_COUNT_FLUSH_SIZE bytes,
+ * so memory stays small whatever the size of the document. In canonical mode each top-level value
+ * is still held in memory until it is complete, to be sorted. jsb_length then gives its exact size.
+ * Pair it with jsb_init_exact to serialize with a single allocation:
+```c
+    Jsb jsb = {.pp = 2};
+    jsb_init_count(&jsb);
+    if (_stringify_User(&jsb, &user)) ...
+    char *out = jsb_init_exact(&jsb, jsb_length(&jsb));
+    if (!out || _stringify_User(&jsb, &user)) ...
+    jsb_free(&jsb); // out is owned by the caller
+```
+ */
+void jsb_init_count(Jsb *jsb);
+/**
+ * Length of the output so far, including what was flushed to a sink.
+ */
+#define jsb_length(jsb) ((jsb)->buffer.flushed + (jsb)->buffer.count)
+/**
+ * Write the next values into a fixed JSB_REALLOC buffer of len + 1 bytes, owned by the caller.
+ * Any sink is dropped. Output longer than len fails instead of reallocating.
+ * Returns the buffer, or NULL on failure.
+ */
+char *jsb_init_exact(Jsb *jsb, size_t len);
+
+#ifdef JSB_ZLIB
+/**
+ * gzip compressing sink (define JSB_ZLIB and link with -lz).
+ * Compressed output is passed to write(ctx, ...) in chunks of up to JSB_GZIP_CHUNK bytes.
+ * Example:
+```c
+    JsbGzip gz;
+    if (jsb_gzip_init(&gz, 6, jsb_fwrite, file)) return -1;
+    Jsb jsb = {.ndjson = true};
+    jsb_init_sink(&jsb, jsb_gzip_write, &gz, 0);
+    ...
+    int err = jsb_flush(&jsb);
+    err = jsb_gzip_finish(&gz) || err;
+    jsb_free(&jsb);
+```
+ */
+typedef struct {
+    z_stream zs;
+    JsbWriteFn write;
+    void *ctx;
+    bool failed;
+    unsigned char out[JSB_GZIP_CHUNK];
+} JsbGzip;
+
+/**
+ * Start a gzip stream, level is a zlib compression level (0-9, or Z_DEFAULT_COMPRESSION).
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_gzip_init(JsbGzip *gz, int level, JsbWriteFn write, void *ctx);
+/**
+ * JsbWriteFn compressing into a JsbGzip.
+ */
+int jsb_gzip_write(void *ctx, const char *data, size_t len);
+/**
+ * Write the end of the stream and release the compressor.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_gzip_finish(JsbGzip *gz);
+/**
+ * Release the compressor without finishing the stream.
+ */
+void jsb_gzip_free(JsbGzip *gz);
+#endif
+
+typedef struct JsbSegment {
+    struct JsbSegment *next;
+    size_t len;
+    char data[];
+} JsbSegment;
+
+/**
+ * Output kept in a chain of fixed-size segments that are never moved,
+ * instead of one buffer that is copied every time it doubles.
+ * segment_size 0 uses JSB_CHAIN_SEGMENT.
+ * Example:
+```c
+    JsbChain chain = {0};
+    Jsb jsb = {0};
+    jsb_init_sink(&jsb, jsb_chain_write, &chain, 16384);
+    ...
+    jsb_flush(&jsb);
+    jsb_free(&jsb);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, jsb_chain_read);
+    curl_easy_setopt(curl, CURLOPT_READDATA, &chain);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)chain.total);
+```
+ */
+typedef struct {
+    JsbSegment *head;
+    JsbSegment *tail;
+    size_t total;
+    size_t segment_size;
+    JsbSegment *read_seg; // jsb_chain_read position
+    size_t read_off;
+    size_t read_total;
+} JsbChain;
+
+/**
+ * JsbWriteFn appending to a JsbChain.
+ */
+int jsb_chain_write(void *ctx, const char *data, size_t len);
+/**
+ * Copy up to size * nmemb bytes starting where the previous call stopped, with the curl
+ * CURLOPT_READFUNCTION signature. Returns the number of bytes copied, 0 at the end.
+ */
+size_t jsb_chain_read(char *dst, size_t size, size_t nmemb, void *chain);
+#ifndef _WIN32
+/**
+ * Fill up to max iovecs with the segments, for writev.
+ * Returns the number of iovecs filled.
+ */
+size_t jsb_chain_iov(const JsbChain *chain, struct iovec *iov, size_t max);
+#endif
+/**
+ * Copy the whole chain into one NUL terminated JSB_REALLOC buffer, the caller owns it.
+ * Returns NULL on failure.
+ */
+char *jsb_chain_flatten(const JsbChain *chain);
+/**
+ * Free all segments.
+ */
+void jsb_chain_free(JsbChain *chain);
+
+/**
+ * Reset the builder for a new document, keeping its buffer and capacity.
+ */
+void jsb_reset(Jsb *jsb);
+/**
+ * Copy the output into an exact-size JSB_REALLOC buffer, the caller owns it.
+ * Returns NULL on failure.
+ */
+char *jsb_dup(Jsb *jsb);
+
+/**
+ * Take a reset builder from the calling thread's pool (or a new one),
+ * with at least size_hint bytes of capacity.
+ * Keep the hint per call site so that steady-state builds never reallocate:
+```c
+    static JSB_THREAD_LOCAL size_t size_hint;
+    Jsb *jsb = jsb_pool_acquire(size_hint);
+    if (!jsb) return NULL;
+    jsb->pp = 2;
+    ...
+    char *out = jsb_pool_take(jsb, &size_hint);
+```
+ * Returns NULL on failure.
+ */
+Jsb *jsb_pool_acquire(size_t size_hint);
+/**
+ * Give the builder back to the calling thread's pool and raise *size_hint (if not NULL)
+ * to the output size. Builders above JSB_POOL_MAX_CAPACITY or beyond JSB_POOL_SIZE are freed.
+ */
+void jsb_pool_release(Jsb *jsb, size_t *size_hint);
+/**
+ * jsb_pool_release that hands the output buffer over to the caller instead of copying it,
+ * the pooled builder allocates a new one on its next jsb_pool_acquire.
+ * The buffer is owned by the caller (JSB_FREE it) and may be larger than the output.
+ * Returns NULL on failure.
+ */
+char *jsb_pool_take(Jsb *jsb, size_t *size_hint);
+/**
+ * Free the builders pooled by the calling thread.
+ * With pthreads this also happens when the thread exits.
+ */
+void jsb_pool_free(void);
+
 /**
  * Begin a JSON object.
  * Returns 0 on success, -1 on failure.
@@ -131,6 +454,17 @@ int jsb_end_array(Jsb *jsb);
  * Returns 0 on success, -1 on failure.
  */
 int jsb_key(Jsb *jsb, const char *key);
+/**
+ * Add a pre-escaped key to the current object with a single copy.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_key_tok(Jsb *jsb, JsbKey key);
+/**
+ * Escape a key at runtime into a JsbKey, release it with jsb_key_free.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_key_init(JsbKey *key, const char *name, bool ascii);
+void jsb_key_free(JsbKey *key);
 /**
  * Add a string value.
  * Returns 0 on success, -1 on failure.
@@ -142,161 +476,1374 @@ int jsb_nstring(Jsb *jsb, const char *str, size_t len);
  * Returns 0 on success, -1 on failure.
  */
 int jsb_int(Jsb *jsb, int value);
+/**
+ * Add a signed 64-bit integer value.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_int64(Jsb *jsb, int64_t value);
+/**
+ * Add an unsigned 64-bit integer value.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_uint64(Jsb *jsb, uint64_t value);
 /**
  * Add a number value.
  * Returns 0 on success, -1 on failure.
  */
 int jsb_number(Jsb *jsb, double value, int precision);
+/**
+ * Add a double value using the shortest representation that round-trips.
+ * NaN and infinities are emitted as null.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_double(Jsb *jsb, double value);
+/**
+ * Add a float value using the shortest representation that round-trips as float.
+ * NaN and infinities are emitted as null.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_float(Jsb *jsb, float value);
 /**
  * Add a boolean value.
  * Returns 0 on success, -1 on failure.
  */
 int jsb_bool(Jsb *jsb, bool value);
 /**
- * Add a formatted date value, accept strftime format string.
+ * Add a formatted date value in local time, accept strftime format string.
  * Returns 0 on success, -1 on failure.
  */
 int jsb_date_fmt(Jsb *jsb, time_t timestamp, const char *fmt);
-#define jsb_date(jsb, timestamp) jsb_date_fmt(jsb, timestamp, "%Y-%m-%d")
-#define jsb_datetime(jsb, timestamp) jsb_date_fmt(jsb, timestamp, "%Y-%m-%dT%H:%M:%SZ")
+/**
+ * Add a UTC ISO-8601 date value, usec is the sub-second part in microseconds.
+ * Years outside 0000-9999 are rejected.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_date_utc(Jsb *jsb, int64_t timestamp, uint32_t usec, JsbDatePrecision precision);
+#define jsb_date(jsb, timestamp) jsb_date_utc(jsb, timestamp, 0, JSB_DATE_DAY)
+#define jsb_datetime(jsb, timestamp) jsb_date_utc(jsb, timestamp, 0, JSB_DATE_SECONDS)
+/**
+ * Add a UTC ISO-8601 datetime from milliseconds since the epoch.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_datetime_ms(Jsb *jsb, int64_t millis);
+/**
+ * Add a UTC ISO-8601 datetime from microseconds since the epoch.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_datetime_us(Jsb *jsb, int64_t micros);
 /**
  * Add a null value.
  * Returns 0 on success, -1 on failure.
  */
 int jsb_null(Jsb *jsb);
+/**
+ * Add an already serialized JSON value as is, a NULL or empty json adds null.
+ * Commas and pretty print newlines are handled like for any other value,
+ * the fragment itself is not re-indented.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_raw(Jsb *jsb, const char *json, size_t len);
+/**
+ * Add binary data as a standard base64 string (with padding), encoded straight into the output.
+ * NULL data adds null.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_base64(Jsb *jsb, const void *data, size_t len);
+
+typedef struct {
+    const void *obj;
+    uint64_t version;
+    int level;
+    int pp;
+    bool ascii;
+    bool canonical;
+    char *json;
+    size_t len;
+} JsbCacheEntry;
+
+/**
+ * Cache of serialized subtrees keyed by object identity and version.
+ * Direct mapped on the object address: a colliding object evicts the previous entry.
+ * Fragments are only reused at the same nesting level and with the same pp/ascii settings.
+ * Example:
+```c
+    static JsbCache cache;
+    if (jsb_cache_get(&jsb, &cache, user, user->version) == 0) {
+        size_t start = jsb_cache_begin(&jsb);
+        _stringify_User(&jsb, user);
+        jsb_cache_put(&jsb, &cache, user, user->version, start);
+    }
+```
+ */
+typedef struct {
+    JsbCacheEntry entries[JSB_CACHE_SIZE];
+} JsbCache;
+
+/**
+ * Add the cached fragment of (obj, version) if present.
+ * Returns 1 if it was added, 0 if it is not cached, -1 on failure.
+ */
+int jsb_cache_get(Jsb *jsb, JsbCache *cache, const void *obj, uint64_t version);
+/**
+ * Mark the start of a value that will be stored with jsb_cache_put.
+ */
+#define jsb_cache_begin(jsb) ((jsb)->buffer.flushed + (jsb)->buffer.count)
+/**
+ * Store the value written since start as the fragment of (obj, version).
+ * A value already partly flushed to a sink is not cached, that is not an error.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_cache_put(Jsb *jsb, JsbCache *cache, const void *obj, uint64_t version, size_t start);
+/**
+ * Free all cached fragments.
+ */
+void jsb_cache_free(JsbCache *cache);
+
+/**
+ * Position saved by jsb_mark.
+ */
+typedef struct {
+    size_t offset;
+    int level;
+    JsbState state;
+    bool is_first;
+    bool is_key;
+} JsbMark;
+
+/**
+ * Save the current output position and builder state for jsb_rollback.
+ * Example:
+```c
+    JsbMark mark = jsb_mark(&jsb);
+    jsb_key(&jsb, "errors");
+    int n = write_errors(&jsb);
+    if (n == 0) jsb_rollback(&jsb, mark); // drop the empty "errors" entry
+```
+ */
+JsbMark jsb_mark(Jsb *jsb);
+/**
+ * Discard everything written after mark and restore the state saved with it.
+ * Containers opened before the mark must not have been closed in between.
+ * Fails if that output was already flushed to a sink or the builder failed.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_rollback(Jsb *jsb, JsbMark mark);
+
+/**
+ * Streaming XXH64 state.
+ */
+typedef struct {
+    uint64_t v[4];
+    uint64_t total;
+    unsigned char buf[32];
+    size_t buffered;
+} JsbHash;
+
+void jsb_hash_init(JsbHash *h, uint64_t seed);
+void jsb_hash_update(JsbHash *h, const void *data, size_t len);
+uint64_t jsb_hash_final(const JsbHash *h);
+
+/**
+ * XXH64 (seed 0) of the current top-level value, excluding the ndjson newline.
+ * In canonical mode the output is hashed as it becomes final, i.e. whenever no object is open,
+ * so equal documents get equal hashes regardless of key order. Call it once the value is complete.
+ * Outside canonical mode the whole pending buffer is hashed.
+ */
+uint64_t jsb_hash(Jsb *jsb);
+
+/**
+ * Writes the i-th element of an array, see jsb_parallel_array.
+ * Returns 0 on success, -1 on failure.
+ */
+typedef int (*JsbItemFn)(Jsb *jsb, size_t i, void *ctx);
+
+/**
+ * Add count array elements written by fn, splitting them across threads.
+ * Every thread writes a contiguous range into its own Jsb chunk, chunks are then appended in order,
+ * so the output is the same as calling fn for every i on jsb.
+ * jsb must be in an array context. fn must only read shared data.
+ * threads <= 0 uses the number of online cores.
+ * Without pthreads (or with JSB_NO_THREADS) elements are written sequentially.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsb_parallel_array(Jsb *jsb, size_t count, JsbItemFn fn, void *ctx, int threads);
 
-#define jsb_get(jsb) (jsb)->buffer.items
+/**
+ * The output, NULL if jsb_failed.
+ */
+char *jsb_get(Jsb *jsb);
 
 #ifdef JSB_IMPLEMENTATION
 
-static void jsb_srealloc(struct jsb_string *sb, size_t new_capacity) {
-    if (new_capacity <= sb->capacity) return;
+static int jsb_sflush(struct jsb_string *sb) {
+    if (sb->failed) return -1;
+    if (!sb->write || !sb->count) return 0;
+    if (sb->write(sb->write_ctx, sb->items, sb->count)) {
+        sb->failed = true;
+        return -1;
+    }
+    sb->flushed += sb->count;
+    sb->count = 0;
+    sb->items[0] = '\0';
+    return 0;
+}
+
+static int jsb_srealloc(struct jsb_string *sb, size_t new_capacity) {
+    if (sb->failed) return -1;
+    if (new_capacity <= sb->capacity) return 0;
+    // With a sink, the buffer is emptied instead of grown past flush_size
+    if (sb->write && sb->count && !sb->hold && (sb->count >= sb->flush_size || (sb->borrowed && !sb->can_grow))) {
+        new_capacity -= sb->count;
+        if (jsb_sflush(sb)) return -1;
+        if (new_capacity <= sb->capacity) return 0;
+    }
+    if (sb->borrowed && !sb->can_grow) {
+        sb->failed = true;
+        return -1;
+    }
     if (new_capacity < JSB_SMIN_CAPACITY) new_capacity = JSB_SMIN_CAPACITY;
     size_t cap = sb->capacity ? sb->capacity : JSB_SMIN_CAPACITY;
     while (cap < new_capacity)
         cap *= 2;
-    sb->items = JSB_REALLOC(sb->items, cap);
-    assert(sb->items != NULL);
+    char *items = JSB_REALLOC(sb->borrowed ? NULL : sb->items, cap);
+    if (!items) {
+        sb->failed = true;
+        return -1;
+    }
+    if (sb->borrowed) {
+        memcpy(items, sb->items, sb->count);
+        sb->borrowed = false;
+    }
+    sb->items = items;
     sb->capacity = cap;
+    return 0;
+}
+/**
+ * Returns where up to max bytes (NUL included) can be written, finish with jsb_scommit.
+ * Normally this is the buffer itself, a full fixed buffer falls back to scratch
+ * so that values are not rejected on their worst-case size.
+ */
+static char *jsb_sreserve(struct jsb_string *sb, size_t max, char *scratch) {
+    if (sb->borrowed && !sb->can_grow && sb->count + max > sb->capacity) return sb->failed ? NULL : scratch;
+    if (jsb_srealloc(sb, sb->count + max)) return NULL;
+    return sb->items + sb->count;
 }
-static void jsb_sappend(struct jsb_string *sb, char c) {
-    jsb_srealloc(sb, sb->count + 2);
-    sb->items[sb->count] = c;
-    if (c != '\0') sb->count++;
+static int jsb_scommit(struct jsb_string *sb, const char *start, const char *end) {
+    size_t n = end - start;
+    if (start != sb->items + sb->count) {
+        if (jsb_srealloc(sb, sb->count + n + 1)) return -1;
+        memcpy(sb->items + sb->count, start, n);
+    }
+    sb->count += n;
+    sb->items[sb->count] = '\0';
+    return 0;
 }
 static void jsb_sappends(struct jsb_string *sb, char *c) {
     size_t len = strlen(c);
-    jsb_srealloc(sb, sb->count + len + 1);
+    if (jsb_srealloc(sb, sb->count + len + 1)) return;
     if (len) {
         memcpy(&sb->items[sb->count], c, len);
         sb->count += len;
     }
     sb->items[sb->count] = '\0';
 }
-
 /**
- * Appends a string to the JSON buffer.
- * It will escape the string and wrap it in quotes.
+ * Appends len bytes, with a sink in slices of up to flush_size so that
+ * a long run is flushed as it goes instead of growing the buffer to fit it.
  */
-static void jsb_escaped_nstring(struct jsb_string *sb, const char *str, size_t len) {
-    jsb_sappend(sb, '"');
-    // escape
-    for (size_t i = 0; i < len; ++i) {
-        switch (str[i]) {
-        case '\n':
-            jsb_sappend(sb, '\\');
-            jsb_sappend(sb, 'n');
-            break;
-        case '\t':
-            jsb_sappend(sb, '\\');
-            jsb_sappend(sb, 't');
-            break;
-        case '"':
-        case '\\':
-            jsb_sappend(sb, '\\');
-            jsb_sappend(sb, str[i]);
-            break;
-        case '\b':
-        case '\r':
-            break;
-        default:
-            jsb_sappend(sb, str[i]);
-        }
+static int jsb_sappendn(struct jsb_string *sb, const char *data, size_t len) {
+    while (len) {
+        size_t n = sb->write && !sb->hold && len > sb->flush_size ? sb->flush_size : len;
+        if (jsb_srealloc(sb, sb->count + n + 1)) return -1;
+        memcpy(sb->items + sb->count, data, n);
+        sb->count += n;
+        sb->items[sb->count] = '\0';
+        data += n;
+        len -= n;
     }
-    jsb_sappend(sb, '"');
-}
-static void jsb_escaped_string(struct jsb_string *sb, const char *str) {
-    jsb_escaped_nstring(sb, str, strlen(str));
+    return sb->failed ? -1 : 0;
 }
 
-/**
- * Values are valid only in:
- * beginning of the document
- * object context after a key
- * array context
- */
-static int jsb_check_val(Jsb *jsb) {
-    JsbState state = jsb->state[jsb->level];
-    if (state == JSB_STATE_ARRAY) return 0;
-    if (state == JSB_STATE_OBJECT && jsb->is_key) return 0;
-    if (state == JSB_STATE_START && jsb->is_first) return 0;
-    return -1;
-}
+static const char jsb_hex_digits[] = "0123456789abcdef";
+static const char jsb_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
 
 /**
- * Adds new line and indentation for pretty printing.
+ * Writes the decimal digits of value to out, two digits at a time.
+ * Returns the pointer past the last digit, out must have room for 20 bytes.
  */
-static void jsb_pretty_print_ch(Jsb *jsb) {
-    if (jsb->pp && !jsb->is_key) {
-        jsb_sappend(&jsb->buffer, '\n');
-        for (int i = 0; i < jsb->level * jsb->pp; ++i) {
-            jsb_sappend(&jsb->buffer, ' ');
-        }
+static char *jsb_write_u64(char *out, uint64_t value) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        size_t idx = (size_t)(value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        memcpy(p, jsb_digit_pairs + idx, 2);
     }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, jsb_digit_pairs + value * 2, 2);
+    } else {
+        *--p = (char)('0' + value);
+    }
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(out, p, n);
+    return out + n;
 }
 
-static void _jsb_init(Jsb *jsb) {
-    jsb->buffer.count = 0;
-    jsb->level = 0;
-    jsb->state[0] = JSB_STATE_START;
-    jsb->is_first = true;
-}
+// Shortest round-trip floating point formatting (Grisu2)
+typedef struct {
+    uint64_t f;
+    int e;
+} JsbDiyFp;
 
-static int _jsb_end(Jsb *jsb) {
-    if (jsb->level != 0) return -1;
-    jsb_sappends(&jsb->buffer, "");
+static const uint64_t jsb_cached_powers_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const int16_t jsb_cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+    -635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+    -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+    -50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+    242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+    534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+    827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+static const uint64_t jsb_pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL};
+
+static JsbDiyFp jsb_diyfp_normalize(JsbDiyFp v) {
+#if defined(__GNUC__)
+    int s = __builtin_clzll(v.f);
+    v.f <<= s;
+    v.e -= s;
+#else
+    while (!(v.f & (1ULL << 63))) {
+        v.f <<= 1;
+        v.e--;
+    }
+#endif
+    return v;
+}
+
+static JsbDiyFp jsb_diyfp_mul(JsbDiyFp x, JsbDiyFp y) {
+    const uint64_t m32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1ULL << 31; // round
+    return (JsbDiyFp){ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+}
+
+static void jsb_grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int jsb_count_digits32(uint32_t n) {
+    int d = 1;
+    while (n >= 10) {
+        n /= 10;
+        d++;
+    }
+    return d;
+}
+
+static int jsb_digit_gen(JsbDiyFp w, JsbDiyFp mp, uint64_t delta, char *buf, int *k) {
+    JsbDiyFp one = {1ULL << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = jsb_count_digits32(p1);
+    int len = 0;
+    while (kappa > 0) {
+        uint32_t div = (uint32_t)jsb_pow10[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if (d || len) buf[len++] = (char)('0' + d);
+        kappa--;
+        uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+        if (tmp <= delta) {
+            *k += kappa;
+            jsb_grisu_round(buf, len, delta, tmp, jsb_pow10[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || len) buf[len++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            jsb_grisu_round(buf, len, delta, p2, one.f, wp_w * (index < 20 ? jsb_pow10[index] : 0));
+            return len;
+        }
+    }
+}
+
+/**
+ * Generates the shortest digits of f * 2^e, with value = digits * 10^k.
+ * lower_closer is set when the lower boundary is half as far as the upper one.
+ * Returns the number of digits written to buf (at most 17).
+ */
+static int jsb_grisu2(uint64_t f, int e, bool lower_closer, char *buf, int *k) {
+    JsbDiyFp plus = jsb_diyfp_normalize((JsbDiyFp){(f << 1) + 1, e - 1});
+    JsbDiyFp minus = lower_closer ? (JsbDiyFp){(f << 2) - 1, e - 2} : (JsbDiyFp){(f << 1) - 1, e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // Cached power c = 10^-k such that the product exponent lands in [-60, -32]
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (ik != dk) ik++;
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    JsbDiyFp c = {jsb_cached_powers_f[index], jsb_cached_powers_e[index]};
+
+    JsbDiyFp w = jsb_diyfp_mul(jsb_diyfp_normalize((JsbDiyFp){f, e}), c);
+    JsbDiyFp wp = jsb_diyfp_mul(plus, c);
+    JsbDiyFp wm = jsb_diyfp_mul(minus, c);
+    wm.f++;
+    wp.f--;
+    return jsb_digit_gen(w, wp, wp.f - wm.f, buf, k);
+}
+
+/**
+ * Lays out digits * 10^k in buf, buf must have room for 32 bytes.
+ * Plain notation is used for integers up to 15 digits and for fractions down
+ * to 1e-6, anything else uses exponent notation ("1e20", "1.5e-9").
+ * Returns the pointer past the last character.
+ */
+static char *jsb_fmt_digits(char *buf, int len, int k) {
+    int kk = len + k; // 10^(kk-1) <= v < 10^kk
+    if (k >= 0 && kk <= 15) {
+        // 1234e3 -> 1234000
+        for (int i = len; i < kk; i++)
+            buf[i] = '0';
+        return buf + kk;
+    }
+    if (0 < kk && kk <= 15) {
+        // 1234e-2 -> 12.34
+        memmove(buf + kk + 1, buf + kk, len - kk);
+        buf[kk] = '.';
+        return buf + len + 1;
+    }
+    if (-6 < kk && kk <= 0) {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(buf + offset, buf, len);
+        buf[0] = '0';
+        buf[1] = '.';
+        for (int i = 2; i < offset; i++)
+            buf[i] = '0';
+        return buf + len + offset;
+    }
+    // 1234e30 -> 1.234e33
+    char *out = buf + 1;
+    if (len > 1) {
+        memmove(buf + 2, buf + 1, len - 1);
+        buf[1] = '.';
+        out = buf + len + 1;
+    }
+    *out++ = 'e';
+    int exp = kk - 1;
+    if (exp < 0) {
+        *out++ = '-';
+        exp = -exp;
+    }
+    return jsb_write_u64(out, (uint64_t)exp);
+}
+
+/**
+ * Returns the length of the prefix of str that can be copied verbatim:
+ * no quotes, backslashes or control characters (and no bytes >= 0x80 in ascii mode).
+ */
+static size_t jsb_clean_run(const char *str, size_t len, bool ascii) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+        int mask = _mm_movemask_epi8(m);
+        if (ascii) mask |= _mm_movemask_epi8(v);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)str + i);
+        uint8x16_t m = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+        m = vorrq_u8(m, vcleq_u8(v, vdupq_n_u8(0x1F)));
+        if (ascii) m = vorrq_u8(m, vcgeq_u8(v, vdupq_n_u8(0x80)));
+        if (vmaxvq_u8(m)) break;
+    }
+#endif
+    for (; i < len; ++i) {
+        unsigned char c = (unsigned char)str[i];
+        if (c < 0x20 || c == '"' || c == '\\' || (ascii && c >= 0x80)) break;
+    }
+    return i;
+}
+
+static char *jsb_write_u16(char *out, unsigned int cp) {
+    out[0] = '\\';
+    out[1] = 'u';
+    out[2] = jsb_hex_digits[(cp >> 12) & 0xF];
+    out[3] = jsb_hex_digits[(cp >> 8) & 0xF];
+    out[4] = jsb_hex_digits[(cp >> 4) & 0xF];
+    out[5] = jsb_hex_digits[cp & 0xF];
+    return out + 6;
+}
+
+/**
+ * Decodes one UTF-8 sequence, returns the number of bytes consumed.
+ * Invalid sequences consume one byte and yield U+FFFD.
+ */
+static size_t jsb_utf8_decode(const unsigned char *s, size_t len, unsigned int *cp) {
+    unsigned int c = s[0];
+    size_t n;
+    unsigned int min;
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    } else if ((c & 0xE0) == 0xC0) {
+        n = 2, min = 0x80, c &= 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        n = 3, min = 0x800, c &= 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        n = 4, min = 0x10000, c &= 0x07;
+    } else {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    if (n > len) {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    for (size_t i = 1; i < n; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *cp = 0xFFFD;
+            return 1;
+        }
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    *cp = c;
+    return n;
+}
+
+/**
+ * Appends a string to the JSON buffer.
+ * It will escape the string and wrap it in quotes.
+ * Clean runs are copied with a single memcpy, only special bytes are escaped.
+ * The caller reserves len + 2 (quotes) + extra bytes and the NUL, extra bytes stay reserved after the closing quote.
+ */
+static void jsb_escaped_nstring(struct jsb_string *sb, const char *str, size_t len, bool ascii, size_t extra) {
+    // Invariant: capacity >= count + remaining input + closing quote + extra + NUL
+    sb->items[sb->count++] = '"';
+    size_t i = 0;
+    while (i < len) {
+        size_t run = jsb_clean_run(str + i, len - i, ascii);
+        if (run) {
+            memcpy(sb->items + sb->count, str + i, run);
+            sb->count += run;
+            i += run;
+            if (i == len) break;
+        }
+        // Longest escape is a surrogate pair (12 bytes)
+        char esc[12];
+        char *out = esc;
+        unsigned char c = (unsigned char)str[i];
+        if (c >= 0x80) {
+            unsigned int cp;
+            i += jsb_utf8_decode((const unsigned char *)str + i, len - i, &cp);
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                out = jsb_write_u16(out, 0xD800 | (cp >> 10));
+                out = jsb_write_u16(out, 0xDC00 | (cp & 0x3FF));
+            } else {
+                out = jsb_write_u16(out, cp);
+            }
+        } else {
+            *out++ = '\\';
+            switch (c) {
+            case '"':
+            case '\\':
+                *out++ = (char)c;
+                break;
+            case '\b':
+                *out++ = 'b';
+                break;
+            case '\f':
+                *out++ = 'f';
+                break;
+            case '\n':
+                *out++ = 'n';
+                break;
+            case '\r':
+                *out++ = 'r';
+                break;
+            case '\t':
+                *out++ = 't';
+                break;
+            default:
+                out = jsb_write_u16(out - 1, c);
+            }
+            i++;
+        }
+        size_t n = out - esc;
+        if (jsb_srealloc(sb, sb->count + n + (len - i) + 2 + extra)) return;
+        memcpy(sb->items + sb->count, esc, n);
+        sb->count += n;
+    }
+    sb->items[sb->count++] = '"';
+    sb->items[sb->count] = '\0';
+}
+static void jsb_escaped_string(struct jsb_string *sb, const char *str, bool ascii) {
+    size_t len = strlen(str);
+    if (jsb_srealloc(sb, sb->count + len + 3)) return;
+    jsb_escaped_nstring(sb, str, len, ascii, 0);
+}
+
+/**
+ * Values are valid only in:
+ * beginning of the document
+ * object context after a key
+ * array context
+ */
+static int jsb_check_val(Jsb *jsb) {
+    if (jsb->buffer.failed) return -1;
+    JsbState state = jsb->state[jsb->level];
+    if (state == JSB_STATE_ARRAY) return 0;
+    if (state == JSB_STATE_OBJECT && jsb->is_key) return 0;
+    if (state == JSB_STATE_START && jsb->is_first) return 0;
+    return -1;
+}
+
+static const char jsb_spaces[] = "                                                                ";
+
+/**
+ * Writes the comma, new line and indentation that precede a value or a key
+ * and reserves extra bytes after them, with a single capacity check.
+ * Returns 0 on success, -1 on failure.
+ */
+static int jsb_prefix(Jsb *jsb, bool comma, size_t extra) {
+    bool newline = jsb->pp > 0 && !jsb->is_key && !jsb->ndjson && !jsb->canonical;
+    size_t indent = newline ? (size_t)jsb->level * jsb->pp : 0;
+    if (jsb_srealloc(&jsb->buffer, jsb->buffer.count + comma + newline + indent + extra + 1)) return -1;
+    char *out = jsb->buffer.items + jsb->buffer.count;
+    if (comma) *out++ = ',';
+    if (newline) *out++ = '\n';
+    while (indent) {
+        size_t n = indent < sizeof(jsb_spaces) - 1 ? indent : sizeof(jsb_spaces) - 1;
+        memcpy(out, jsb_spaces, n);
+        out += n;
+        indent -= n;
+    }
+    *out = '\0';
+    jsb->buffer.count = out - jsb->buffer.items;
+    return 0;
+}
+
+/**
+ * jsb_prefix followed by len bytes of str.
+ * Returns 0 on success, -1 on failure.
+ */
+static int jsb_emit(Jsb *jsb, bool comma, const char *str, size_t len) {
+    if (jsb_prefix(jsb, comma, len)) return -1;
+    memcpy(jsb->buffer.items + jsb->buffer.count, str, len);
+    jsb->buffer.count += len;
+    jsb->buffer.items[jsb->buffer.count] = '\0';
+    return 0;
+}
+
+/**
+ * jsb_prefix that also reserves max bytes (NUL included) for a value of unknown length,
+ * finish with jsb_scommit. A fixed buffer only reserves the prefix and falls back to scratch,
+ * see jsb_sreserve.
+ * Returns where the value can be written, or NULL on failure.
+ */
+static char *jsb_prefix_reserve(Jsb *jsb, bool comma, size_t max, char *scratch) {
+    bool fixed = jsb->buffer.borrowed && !jsb->buffer.can_grow;
+    if (jsb_prefix(jsb, comma, fixed ? 0 : max)) return NULL;
+    if (fixed) return jsb_sreserve(&jsb->buffer, max, scratch);
+    return jsb->buffer.items + jsb->buffer.count;
+}
+
+#define JSB_XXH_P1 0x9E3779B185EBCA87ULL
+#define JSB_XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define JSB_XXH_P3 0x165667B19E3779F9ULL
+#define JSB_XXH_P4 0x85EBCA77C2B2AE63ULL
+#define JSB_XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t jsb_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t jsb_read64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint64_t jsb_xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * JSB_XXH_P2;
+    return jsb_rotl64(acc, 31) * JSB_XXH_P1;
+}
+
+static inline uint64_t jsb_xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= jsb_xxh_round(0, val);
+    return acc * JSB_XXH_P1 + JSB_XXH_P4;
+}
+
+static const unsigned char *jsb_xxh_stripes(uint64_t v[4], const unsigned char *p, const unsigned char *end) {
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    while (end - p >= 32) {
+        v0 = jsb_xxh_round(v0, jsb_read64(p));
+        v1 = jsb_xxh_round(v1, jsb_read64(p + 8));
+        v2 = jsb_xxh_round(v2, jsb_read64(p + 16));
+        v3 = jsb_xxh_round(v3, jsb_read64(p + 24));
+        p += 32;
+    }
+    v[0] = v0, v[1] = v1, v[2] = v2, v[3] = v3;
+    return p;
+}
+
+void jsb_hash_init(JsbHash *h, uint64_t seed) {
+    *h = (JsbHash){.v = {seed + JSB_XXH_P1 + JSB_XXH_P2, seed + JSB_XXH_P2, seed, seed - JSB_XXH_P1}};
+}
+
+void jsb_hash_update(JsbHash *h, const void *data, size_t len) {
+    const unsigned char *p = data, *end = p + len;
+    h->total += len;
+    if (h->buffered + len < 32) {
+        if (len) memcpy(h->buf + h->buffered, p, len);
+        h->buffered += len;
+        return;
+    }
+    if (h->buffered) {
+        size_t n = 32 - h->buffered;
+        memcpy(h->buf + h->buffered, p, n);
+        p += n;
+        jsb_xxh_stripes(h->v, h->buf, h->buf + 32);
+        h->buffered = 0;
+    }
+    p = jsb_xxh_stripes(h->v, p, end);
+    h->buffered = end - p;
+    if (h->buffered) memcpy(h->buf, p, h->buffered);
+}
+
+uint64_t jsb_hash_final(const JsbHash *h) {
+    uint64_t acc;
+    if (h->total >= 32) {
+        acc = jsb_rotl64(h->v[0], 1) + jsb_rotl64(h->v[1], 7) + jsb_rotl64(h->v[2], 12) + jsb_rotl64(h->v[3], 18);
+        for (int i = 0; i < 4; ++i)
+            acc = jsb_xxh_merge(acc, h->v[i]);
+    } else {
+        // v[2] holds the seed until the first stripe
+        acc = h->v[2] + JSB_XXH_P5;
+    }
+    acc += h->total;
+    const unsigned char *p = h->buf, *end = h->buf + h->buffered;
+    for (; end - p >= 8; p += 8) {
+        acc ^= jsb_xxh_round(0, jsb_read64(p));
+        acc = jsb_rotl64(acc, 27) * JSB_XXH_P1 + JSB_XXH_P4;
+    }
+    if (end - p >= 4) {
+        uint64_t k = (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+        acc ^= k * JSB_XXH_P1;
+        acc = jsb_rotl64(acc, 23) * JSB_XXH_P2 + JSB_XXH_P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        acc ^= *p * JSB_XXH_P5;
+        acc = jsb_rotl64(acc, 11) * JSB_XXH_P1;
+    }
+    acc ^= acc >> 33;
+    acc *= JSB_XXH_P2;
+    acc ^= acc >> 29;
+    acc *= JSB_XXH_P3;
+    acc ^= acc >> 32;
+    return acc;
+}
+
+typedef struct {
+    const char *key; // escaped key, without quotes
+    size_t key_len;
+    size_t start; // entry offset in the buffer, including the leading comma
+    size_t len;
+} JsbCanonEntry;
+
+struct jsb_canon {
+    // Offsets of the entries of all open objects, in output order
+    size_t *entries;
+    size_t count;
+    size_t capacity;
+    size_t base[JSB_MAX_NESTING]; // first entry of the object at each level
+    int objects;                  // open objects, output before the outermost one can still move
+    size_t start;                 // absolute offset of the top-level value
+    size_t hashed;                // absolute offset hashed so far
+    JsbHash hash;
+    JsbCanonEntry *sorted; // per-object scratch
+    size_t sorted_capacity;
+    char *tmp;
+    size_t tmp_capacity;
+};
+
+void _jsb_free_canon(Jsb *jsb) {
+    if (!jsb->canon) return;
+    JSB_FREE(jsb->canon->entries);
+    JSB_FREE(jsb->canon->sorted);
+    JSB_FREE(jsb->canon->tmp);
+    JSB_FREE(jsb->canon);
+    jsb->canon = NULL;
+}
+
+/**
+ * Canonical state of jsb, allocated on first use.
+ * Returns NULL on failure.
+ */
+static struct jsb_canon *jsb_canon(Jsb *jsb) {
+    if (!jsb->canon) {
+        jsb->canon = JSB_REALLOC(NULL, sizeof(*jsb->canon));
+        if (!jsb->canon) {
+            jsb->buffer.failed = true;
+            return NULL;
+        }
+        memset(jsb->canon, 0, sizeof(*jsb->canon));
+        jsb_hash_init(&jsb->canon->hash, 0);
+    }
+    jsb->buffer.hold = true;
+    return jsb->canon;
+}
+
+static int jsb_canon_grow(Jsb *jsb, void **items, size_t *capacity, size_t size, size_t n) {
+    if (n <= *capacity) return 0;
+    size_t cap = *capacity ? *capacity : 16;
+    while (cap < n)
+        cap *= 2;
+    void *p = JSB_REALLOC(*items, cap * size);
+    if (!p) {
+        jsb->buffer.failed = true;
+        return -1;
+    }
+    *items = p;
+    *capacity = cap;
+    return 0;
+}
+
+/**
+ * Record an object entry starting at offset start (before its comma).
+ * Returns 0 on success, -1 on failure.
+ */
+static int jsb_canon_key(Jsb *jsb, size_t start) {
+    struct jsb_canon *c = jsb_canon(jsb);
+    if (!c || jsb_canon_grow(jsb, (void **)&c->entries, &c->capacity, sizeof(size_t), c->count + 1)) return -1;
+    c->entries[c->count++] = start;
+    return 0;
+}
+
+static int jsb_canon_cmp(const void *a, const void *b) {
+    const JsbCanonEntry *x = a, *y = b;
+    size_t n = x->key_len < y->key_len ? x->key_len : y->key_len;
+    int r = memcmp(x->key, y->key, n);
+    if (r) return r;
+    if (x->key_len != y->key_len) return x->key_len < y->key_len ? -1 : 1;
+    // Duplicate keys keep their order
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/**
+ * Sort the entries of the object being closed by their escaped key bytes, in place.
+ * Returns 0 on success, -1 on failure.
+ */
+static int jsb_canon_sort(Jsb *jsb) {
+    struct jsb_canon *c = jsb_canon(jsb);
+    if (!c) return -1;
+    size_t base = c->base[jsb->level], n = c->count - base;
+    c->count = base;
+    c->objects--;
+    if (n < 2) return 0;
+    if (jsb_canon_grow(jsb, (void **)&c->sorted, &c->sorted_capacity, sizeof(JsbCanonEntry), n)) return -1;
+    const char *items = jsb->buffer.items;
+    bool sorted = true;
+    for (size_t i = 0; i < n; ++i) {
+        JsbCanonEntry *e = &c->sorted[i];
+        e->start = c->entries[base + i];
+        e->len = (i + 1 < n ? c->entries[base + i + 1] : jsb->buffer.count) - e->start;
+        const char *p = items + e->start + (items[e->start] == ',') + 1;
+        e->key = p;
+        while (*p != '"')
+            p += *p == '\\' ? 2 : 1;
+        e->key_len = p - e->key;
+        if (i && sorted && jsb_canon_cmp(&c->sorted[i - 1], e) > 0) sorted = false;
+    }
+    if (sorted) return 0;
+    qsort(c->sorted, n, sizeof(JsbCanonEntry), jsb_canon_cmp);
+    size_t begin = c->entries[base], total = jsb->buffer.count - begin;
+    if (jsb_canon_grow(jsb, (void **)&c->tmp, &c->tmp_capacity, 1, total)) return -1;
+    // The first entry has no comma, the others do: copy the bodies and put commas between them
+    char *out = c->tmp;
+    for (size_t i = 0; i < n; ++i) {
+        const JsbCanonEntry *e = &c->sorted[i];
+        bool comma = items[e->start] == ',';
+        if (i) *out++ = ',';
+        memcpy(out, items + e->start + comma, e->len - comma);
+        out += e->len - comma;
+    }
+    memcpy(jsb->buffer.items + begin, c->tmp, total);
+    return 0;
+}
+
+/**
+ * Hash the output that can no longer move, i.e. when no object is open.
+ */
+static void jsb_canon_hash(Jsb *jsb) {
+    struct jsb_canon *c = jsb->canon;
+    // A complete value was hashed when it was closed, the ndjson newline is not part of it
+    if (!c || c->objects > 0 || jsb->buffer.failed || (jsb->level == 0 && jsb->state[0] == JSB_STATE_END)) return;
+    size_t end = jsb->buffer.flushed + jsb->buffer.count;
+    if (c->hashed < jsb->buffer.flushed || c->hashed >= end) return;
+    jsb_hash_update(&c->hash, jsb->buffer.items + (c->hashed - jsb->buffer.flushed), end - c->hashed);
+    c->hashed = end;
+}
+
+uint64_t jsb_hash(Jsb *jsb) {
+    if (!jsb->canonical || !jsb->canon) {
+        JsbHash h;
+        jsb_hash_init(&h, 0);
+        size_t len = jsb->buffer.count;
+        if (jsb->ndjson && len && jsb->buffer.items[len - 1] == '\n') len--;
+        jsb_hash_update(&h, jsb->buffer.items, len);
+        return jsb_hash_final(&h);
+    }
+    jsb_canon_hash(jsb);
+    return jsb_hash_final(&jsb->canon->hash);
+}
+
+static void _jsb_init(Jsb *jsb) {
+    // A failed document is not restarted: its output stays failed until jsb_reset
+    if (jsb->buffer.failed) return;
+    // In ndjson mode the previous records are kept until flushed
+    if (!jsb->ndjson) {
+        jsb->buffer.count = 0;
+        jsb->buffer.flushed = 0;
+    }
+    jsb->level = 0;
+    jsb->state[0] = JSB_STATE_START;
+    jsb->is_first = true;
+    jsb->buffer.hold = false;
+    if (jsb->canonical) {
+        struct jsb_canon *c = jsb_canon(jsb);
+        if (!c) return;
+        c->count = 0;
+        c->objects = 0;
+        c->start = c->hashed = jsb->buffer.flushed + jsb->buffer.count;
+        jsb_hash_init(&c->hash, 0);
+    }
+}
+
+static int _jsb_end(Jsb *jsb) {
+    if (jsb->level != 0) return -1;
+    jsb_sappends(&jsb->buffer, jsb->ndjson ? "\n" : "");
     jsb->state[0] = JSB_STATE_END;
+    if (jsb->ndjson && jsb->buffer.count >= jsb->buffer.flush_size) return jsb_sflush(&jsb->buffer);
+    return 0;
+}
+
+void jsb_init_buffer(Jsb *jsb, char *buffer, size_t capacity, bool can_grow) {
+    jsb_free(jsb);
+    jsb->buffer.items = buffer;
+    jsb->buffer.capacity = capacity;
+    jsb->buffer.borrowed = true;
+    jsb->buffer.can_grow = can_grow;
+    jsb->level = 0;
+    jsb->state[0] = JSB_STATE_START;
+}
+
+void jsb_init_sink(Jsb *jsb, JsbWriteFn write, void *ctx, size_t flush_size) {
+    jsb->buffer.write = write;
+    jsb->buffer.write_ctx = ctx;
+    jsb->buffer.flush_size = flush_size ? flush_size : JSB_FLUSH_SIZE;
+    jsb->buffer.flushed = 0;
+}
+
+int jsb_flush(Jsb *jsb) {
+    // Canonical objects are still sorted in place until the top-level value is complete
+    if (jsb->canonical && jsb->level > 0) return 0;
+    return jsb_sflush(&jsb->buffer);
+}
+
+int jsb_fwrite(void *file, const char *data, size_t len) {
+    return fwrite(data, 1, len, file) == len ? 0 : -1;
+}
+
+static int jsb_discard(void *ctx, const char *data, size_t len) {
+    (void)ctx;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+void jsb_init_count(Jsb *jsb) {
+    jsb_init_sink(jsb, jsb_discard, NULL, JSB_COUNT_FLUSH_SIZE);
+}
+
+char *jsb_init_exact(Jsb *jsb, size_t len) {
+    char *out = JSB_REALLOC(NULL, len + 1);
+    if (!out) return NULL;
+    out[0] = '\0';
+    jsb_init_buffer(jsb, out, len + 1, false);
+    jsb->buffer.write = NULL;
+    jsb->buffer.write_ctx = NULL;
+    jsb->buffer.count = 0;
+    jsb->buffer.flushed = 0;
+    return out;
+}
+
+#ifdef JSB_ZLIB
+int jsb_gzip_init(JsbGzip *gz, int level, JsbWriteFn write, void *ctx) {
+    memset(&gz->zs, 0, sizeof(gz->zs));
+    gz->write = write;
+    gz->ctx = ctx;
+    gz->failed = false;
+    // 15 window bits + 16 for a gzip header and trailer
+    if (deflateInit2(&gz->zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        gz->failed = true;
+        return -1;
+    }
+    return 0;
+}
+
+static int jsb_gzip_deflate(JsbGzip *gz, int flush) {
+    int ret;
+    do {
+        gz->zs.next_out = gz->out;
+        gz->zs.avail_out = sizeof(gz->out);
+        ret = deflate(&gz->zs, flush);
+        if (ret == Z_STREAM_ERROR) return -1;
+        size_t n = sizeof(gz->out) - gz->zs.avail_out;
+        if (n && gz->write(gz->ctx, (const char *)gz->out, n)) return -1;
+    } while (gz->zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    return 0;
+}
+
+int jsb_gzip_write(void *ctx, const char *data, size_t len) {
+    JsbGzip *gz = ctx;
+    if (gz->failed) return -1;
+    while (len) {
+        // avail_in is 32 bits
+        uInt n = len > 0x40000000 ? 0x40000000 : (uInt)len;
+        gz->zs.next_in = (Bytef *)data;
+        gz->zs.avail_in = n;
+        if (jsb_gzip_deflate(gz, Z_NO_FLUSH)) {
+            gz->failed = true;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
     return 0;
 }
 
+int jsb_gzip_finish(JsbGzip *gz) {
+    int err = gz->failed ? -1 : 0;
+    if (!err) {
+        gz->zs.next_in = NULL;
+        gz->zs.avail_in = 0;
+        err = jsb_gzip_deflate(gz, Z_FINISH);
+    }
+    jsb_gzip_free(gz);
+    return err;
+}
+
+void jsb_gzip_free(JsbGzip *gz) {
+    deflateEnd(&gz->zs);
+    gz->failed = true;
+}
+#endif
+
+int jsb_chain_write(void *ctx, const char *data, size_t len) {
+    JsbChain *chain = ctx;
+    size_t segment_size = chain->segment_size ? chain->segment_size : JSB_CHAIN_SEGMENT;
+    while (len) {
+        JsbSegment *seg = chain->tail;
+        if (!seg || seg->len == segment_size) {
+            seg = JSB_REALLOC(NULL, sizeof(JsbSegment) + segment_size);
+            if (!seg) return -1;
+            seg->next = NULL;
+            seg->len = 0;
+            if (chain->tail) chain->tail->next = seg;
+            else chain->head = seg;
+            chain->tail = seg;
+        }
+        size_t n = segment_size - seg->len;
+        if (n > len) n = len;
+        memcpy(seg->data + seg->len, data, n);
+        seg->len += n;
+        chain->total += n;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+size_t jsb_chain_read(char *dst, size_t size, size_t nmemb, void *ctx) {
+    JsbChain *chain = ctx;
+    size_t max = size * nmemb, n = 0;
+    if (!chain->read_seg && !chain->read_total) chain->read_seg = chain->head;
+    while (n < max && chain->read_seg) {
+        JsbSegment *seg = chain->read_seg;
+        size_t k = seg->len - chain->read_off;
+        if (k > max - n) k = max - n;
+        memcpy(dst + n, seg->data + chain->read_off, k);
+        n += k;
+        chain->read_off += k;
+        if (chain->read_off == seg->len) {
+            chain->read_seg = seg->next;
+            chain->read_off = 0;
+        }
+    }
+    chain->read_total += n;
+    return n;
+}
+
+#ifndef _WIN32
+size_t jsb_chain_iov(const JsbChain *chain, struct iovec *iov, size_t max) {
+    size_t n = 0;
+    for (JsbSegment *seg = chain->head; seg && n < max; seg = seg->next) {
+        iov[n].iov_base = seg->data;
+        iov[n].iov_len = seg->len;
+        n++;
+    }
+    return n;
+}
+#endif
+
+char *jsb_chain_flatten(const JsbChain *chain) {
+    char *out = JSB_REALLOC(NULL, chain->total + 1);
+    if (!out) return NULL;
+    size_t n = 0;
+    for (JsbSegment *seg = chain->head; seg; seg = seg->next) {
+        memcpy(out + n, seg->data, seg->len);
+        n += seg->len;
+    }
+    out[n] = '\0';
+    return out;
+}
+
+void jsb_chain_free(JsbChain *chain) {
+    JsbSegment *seg = chain->head;
+    while (seg) {
+        JsbSegment *next = seg->next;
+        JSB_FREE(seg);
+        seg = next;
+    }
+    *chain = (JsbChain){.segment_size = chain->segment_size};
+}
+
+void jsb_reset(Jsb *jsb) {
+    jsb->buffer.count = 0;
+    jsb->buffer.flushed = 0;
+    jsb->buffer.failed = false;
+    if (jsb->buffer.items) jsb->buffer.items[0] = '\0';
+    jsb->level = 0;
+    jsb->state[0] = JSB_STATE_START;
+    jsb->is_first = true;
+    jsb->is_key = false;
+}
+
+char *jsb_get(Jsb *jsb) {
+    return jsb_failed(jsb) ? NULL : jsb->buffer.items;
+}
+
+char *jsb_dup(Jsb *jsb) {
+    if (jsb_failed(jsb) || !jsb->buffer.items) return NULL;
+    char *out = JSB_REALLOC(NULL, jsb->buffer.count + 1);
+    if (!out) return NULL;
+    memcpy(out, jsb->buffer.items, jsb->buffer.count);
+    out[jsb->buffer.count] = '\0';
+    return out;
+}
+
+static JSB_THREAD_LOCAL Jsb *jsb_pool[JSB_POOL_SIZE];
+static JSB_THREAD_LOCAL int jsb_pool_count;
+
+#ifdef JSB_THREADS
+static pthread_key_t jsb_pool_key;
+static pthread_once_t jsb_pool_once = PTHREAD_ONCE_INIT;
+
+static void jsb_pool_exit(void *arg) {
+    (void)arg;
+    jsb_pool_free();
+}
+
+static void jsb_pool_key_init(void) {
+    pthread_key_create(&jsb_pool_key, jsb_pool_exit);
+}
+#endif
+
+Jsb *jsb_pool_acquire(size_t size_hint) {
+    Jsb *jsb;
+    if (jsb_pool_count > 0) {
+        jsb = jsb_pool[--jsb_pool_count];
+    } else {
+        jsb = JSB_REALLOC(NULL, sizeof(*jsb));
+        if (!jsb) return NULL;
+        memset(jsb, 0, sizeof(*jsb));
+    }
+    struct jsb_string buffer = jsb->buffer;
+    buffer.write = NULL;
+    buffer.write_ctx = NULL;
+    buffer.hold = false;
+    struct jsb_canon *canon = jsb->canon;
+    *jsb = (Jsb){.buffer = buffer, .canon = canon};
+    jsb_reset(jsb);
+    if (size_hint > JSB_POOL_MAX_CAPACITY) size_hint = JSB_POOL_MAX_CAPACITY;
+    if (jsb_srealloc(&jsb->buffer, size_hint)) {
+        jsb_free(jsb);
+        JSB_FREE(jsb);
+        return NULL;
+    }
+    return jsb;
+}
+
+void jsb_pool_release(Jsb *jsb, size_t *size_hint) {
+    if (!jsb) return;
+    if (size_hint && !jsb_failed(jsb) && jsb->buffer.count + 1 > *size_hint) *size_hint = jsb->buffer.count + 1;
+    if (jsb_pool_count < JSB_POOL_SIZE && !jsb->buffer.borrowed && jsb->buffer.capacity <= JSB_POOL_MAX_CAPACITY) {
+#ifdef JSB_THREADS
+        // Any non-NULL value runs jsb_pool_exit when the thread exits
+        if (jsb_pool_count == 0) {
+            pthread_once(&jsb_pool_once, jsb_pool_key_init);
+            pthread_setspecific(jsb_pool_key, jsb_pool);
+        }
+#endif
+        jsb_pool[jsb_pool_count++] = jsb;
+        return;
+    }
+    jsb_free(jsb);
+    JSB_FREE(jsb);
+}
+
+char *jsb_pool_take(Jsb *jsb, size_t *size_hint) {
+    if (!jsb) return NULL;
+    // A caller buffer or the pending output of a sink is copied
+    if (jsb_failed(jsb) || !jsb->buffer.items || jsb->buffer.borrowed || jsb->buffer.write) {
+        char *out = jsb_dup(jsb);
+        jsb_pool_release(jsb, size_hint);
+        return out;
+    }
+    if (size_hint && jsb->buffer.count + 1 > *size_hint) *size_hint = jsb->buffer.count + 1;
+    char *out = jsb->buffer.items;
+    // Give back a mostly unused buffer, shrinking in place is cheaper than a copy
+    if (jsb->buffer.capacity / 2 > jsb->buffer.count + 1) {
+        char *shrunk = JSB_REALLOC(out, jsb->buffer.count + 1);
+        if (shrunk) out = shrunk;
+    }
+    jsb->buffer.items = NULL;
+    jsb->buffer.count = 0;
+    jsb->buffer.capacity = 0;
+    jsb_pool_release(jsb, NULL);
+    return out;
+}
+
+void jsb_pool_free(void) {
+    while (jsb_pool_count > 0) {
+        Jsb *jsb = jsb_pool[--jsb_pool_count];
+        jsb_free(jsb);
+        JSB_FREE(jsb);
+    }
+}
+
 int jsb_begin_object(Jsb *jsb) {
     if (jsb->level == 0) _jsb_init(jsb);
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    jsb_sappend(&jsb->buffer, '{');
+    if (jsb_emit(jsb, !jsb->is_first, "{", 1)) return -1;
     jsb->state[++jsb->level] = JSB_STATE_OBJECT;
+    if (jsb->canonical) {
+        struct jsb_canon *c = jsb_canon(jsb);
+        if (!c) return -1;
+        c->base[jsb->level] = c->count;
+        c->objects++;
+    }
     jsb->is_first = true;
     jsb->is_key = false;
     return 0;
 }
 
 int jsb_end_object(Jsb *jsb) {
+    if (jsb_failed(jsb)) return -1;
     if (jsb->level < 1 || jsb->state[jsb->level] != JSB_STATE_OBJECT) return -1;
+    if (jsb->canonical && jsb_canon_sort(jsb)) return -1;
     jsb->level--;
-    jsb_pretty_print_ch(jsb);
-    jsb_sappend(&jsb->buffer, '}');
+    if (jsb_emit(jsb, false, "}", 1)) return -1;
+    jsb_canon_hash(jsb);
     if (jsb->level == 0) _jsb_end(jsb);
     jsb->is_first = false;
-    return 0;
+    return jsb_failed(jsb) ? -1 : 0;
 }
 
 int jsb_begin_array(Jsb *jsb) {
     if (jsb->level == 0) _jsb_init(jsb);
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    jsb_sappend(&jsb->buffer, '[');
+    if (jsb_emit(jsb, !jsb->is_first, "[", 1)) return -1;
     jsb->state[++jsb->level] = JSB_STATE_ARRAY;
     jsb->is_first = true;
     jsb->is_key = false;
@@ -304,69 +1851,165 @@ int jsb_begin_array(Jsb *jsb) {
 }
 
 int jsb_end_array(Jsb *jsb) {
-    if (jsb->state[jsb->level] != JSB_STATE_ARRAY) return -1;
+    if (jsb_failed(jsb)) return -1;
+    if (jsb->level < 1 || jsb->state[jsb->level] != JSB_STATE_ARRAY) return -1;
     jsb->level--;
-    jsb_pretty_print_ch(jsb);
-    jsb_sappend(&jsb->buffer, ']');
+    if (jsb_emit(jsb, false, "]", 1)) return -1;
+    jsb_canon_hash(jsb);
     if (jsb->level == 0) _jsb_end(jsb);
     jsb->is_first = false;
-    return 0;
+    return jsb_failed(jsb) ? -1 : 0;
 }
 
 int jsb_key(Jsb *jsb, const char *key) {
+    if (jsb_failed(jsb)) return -1;
+    if (jsb->state[jsb->level] != JSB_STATE_OBJECT || jsb->is_key) return -1;
+    size_t len = strlen(key);
+    if (jsb->canonical && jsb_canon_key(jsb, jsb->buffer.count)) return -1;
+    // Quotes and ": "
+    size_t sep = jsb->canonical ? 1 : 2;
+    if (jsb_prefix(jsb, !jsb->is_first, len + 2 + sep)) return -1;
+    jsb_escaped_nstring(&jsb->buffer, key, len, jsb->ascii, sep);
+    if (jsb_failed(jsb)) return -1;
+    memcpy(jsb->buffer.items + jsb->buffer.count, ": ", sep);
+    jsb->buffer.count += sep;
+    jsb->buffer.items[jsb->buffer.count] = '\0';
+    jsb->is_first = true;
+    jsb->is_key = true;
+    return jsb_failed(jsb) ? -1 : 0;
+}
+
+int jsb_key_tok(Jsb *jsb, JsbKey key) {
+    if (jsb_failed(jsb)) return -1;
     if (jsb->state[jsb->level] != JSB_STATE_OBJECT || jsb->is_key) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    jsb_escaped_string(&jsb->buffer, key);
-    jsb_sappends(&jsb->buffer, ": ");
+    if (jsb->canonical) {
+        if (jsb_canon_key(jsb, jsb->buffer.count)) return -1;
+        // Drop the space after the colon
+        if (key.len && key.str[key.len - 1] == ' ') key.len--;
+    }
+    if (jsb_emit(jsb, !jsb->is_first, key.str, key.len)) return -1;
     jsb->is_first = true;
     jsb->is_key = true;
     return 0;
 }
 
+int jsb_key_init(JsbKey *key, const char *name, bool ascii) {
+    if (!name) return -1;
+    struct jsb_string sb = {0};
+    jsb_escaped_string(&sb, name, ascii);
+    jsb_sappends(&sb, ": ");
+    if (sb.failed) {
+        JSB_FREE(sb.items);
+        return -1;
+    }
+    key->str = sb.items;
+    key->len = sb.count;
+    return 0;
+}
+
+void jsb_key_free(JsbKey *key) {
+    JSB_FREE((char *)key->str);
+    key->str = NULL;
+    key->len = 0;
+}
+
 int jsb_nstring(Jsb *jsb, const char *str, size_t len) {
     if (!str) return jsb_null(jsb);
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    jsb_escaped_nstring(&jsb->buffer, str, len);
-    jsb_sappend(&jsb->buffer, '\0');
+    if (jsb_prefix(jsb, !jsb->is_first, len + 2)) return -1;
+    jsb_escaped_nstring(&jsb->buffer, str, len, jsb->ascii, 0);
     jsb->is_first = false;
     jsb->is_key = false;
-    return 0;
+    return jsb_failed(jsb) ? -1 : 0;
 }
 
-int jsb_int(Jsb *jsb, int value) {
+/**
+ * Writes an integer straight into the buffer, negative values are emitted
+ * with a leading '-' and the magnitude computed in unsigned arithmetic.
+ */
+static int jsb_integer(Jsb *jsb, uint64_t magnitude, bool negative) {
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    char numbuf[16];
-    int n = snprintf(numbuf, sizeof(numbuf), "%d", value);
-    if (n < 0) return -1;
-    jsb_sappends(&jsb->buffer, numbuf);
+    char scratch[22];
+    char *start = jsb_prefix_reserve(jsb, !jsb->is_first, sizeof(scratch), scratch);
+    if (!start) return -1;
+    char *out = start;
+    if (negative) *out++ = '-';
+    out = jsb_write_u64(out, magnitude);
+    if (jsb_scommit(&jsb->buffer, start, out)) return -1;
     jsb->is_first = false;
     jsb->is_key = false;
     return 0;
 }
 
+int jsb_int(Jsb *jsb, int value) {
+    return jsb_int64(jsb, value);
+}
+
+int jsb_int64(Jsb *jsb, int64_t value) {
+    if (value < 0) return jsb_integer(jsb, (uint64_t)0 - (uint64_t)value, true);
+    return jsb_integer(jsb, (uint64_t)value, false);
+}
+
+int jsb_uint64(Jsb *jsb, uint64_t value) {
+    return jsb_integer(jsb, value, false);
+}
+
 int jsb_number(Jsb *jsb, double value, int precision) {
+    if (jsb->canonical) return jsb_double(jsb, value);
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
     char numbuf[64];
     int n = snprintf(numbuf, sizeof(numbuf), "%.*f", precision, value);
     if (n < 0) return -1;
-    jsb_sappends(&jsb->buffer, numbuf);
+    if ((size_t)n >= sizeof(numbuf)) n = sizeof(numbuf) - 1;
+    if (jsb_emit(jsb, !jsb->is_first, numbuf, n)) return -1;
+    jsb->is_first = false;
+    jsb->is_key = false;
+    return 0;
+}
+
+static int jsb_shortest(Jsb *jsb, uint64_t f, int e, bool lower_closer, bool negative) {
+    if (jsb_check_val(jsb)) return -1;
+    char scratch[34];
+    char *start = jsb_prefix_reserve(jsb, !jsb->is_first, sizeof(scratch), scratch);
+    if (!start) return -1;
+    char *out = start;
+    if (f == 0) {
+        *out++ = '0';
+    } else {
+        if (negative) *out++ = '-';
+        int k;
+        int len = jsb_grisu2(f, e, lower_closer, out, &k);
+        out = jsb_fmt_digits(out, len, k);
+    }
+    if (jsb_scommit(&jsb->buffer, start, out)) return -1;
     jsb->is_first = false;
     jsb->is_key = false;
     return 0;
 }
 
+int jsb_double(Jsb *jsb, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_e = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & ((1ULL << 52) - 1);
+    if (biased_e == 0x7FF) return jsb_null(jsb);
+    if (biased_e == 0) return jsb_shortest(jsb, significand, 1 - 1075, false, bits >> 63);
+    return jsb_shortest(jsb, significand | (1ULL << 52), biased_e - 1075, significand == 0 && biased_e > 1, bits >> 63);
+}
+
+int jsb_float(Jsb *jsb, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_e = (int)((bits >> 23) & 0xFF);
+    uint32_t significand = bits & ((1U << 23) - 1);
+    if (biased_e == 0xFF) return jsb_null(jsb);
+    if (biased_e == 0) return jsb_shortest(jsb, significand, 1 - 150, false, bits >> 31);
+    return jsb_shortest(jsb, significand | (1U << 23), biased_e - 150, significand == 0 && biased_e > 1, bits >> 31);
+}
+
 int jsb_bool(Jsb *jsb, bool value) {
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    jsb_sappends(&jsb->buffer, value ? "true" : "false");
+    if (jsb_emit(jsb, !jsb->is_first, value ? "true" : "false", value ? 4 : 5)) return -1;
     jsb->is_first = false;
     jsb->is_key = false;
     return 0;
@@ -374,25 +2017,358 @@ int jsb_bool(Jsb *jsb, bool value) {
 
 int jsb_null(Jsb *jsb) {
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
-    jsb_sappends(&jsb->buffer, "null");
+    if (jsb_emit(jsb, !jsb->is_first, "null", 4)) return -1;
+    jsb->is_first = false;
+    jsb->is_key = false;
+    return 0;
+}
+
+int jsb_raw(Jsb *jsb, const char *json, size_t len) {
+    if (!json || !len) return jsb_null(jsb);
+    if (jsb_check_val(jsb)) return -1;
+    if (jsb_emit(jsb, !jsb->is_first, json, len)) return -1;
+    jsb->is_first = false;
+    jsb->is_key = false;
+    return 0;
+}
+
+static const char jsb_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#if defined(__SSSE3__)
+/**
+ * Encodes 12 bytes into 16 characters, reading 16 bytes from src.
+ * See http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+ */
+static void jsb_base64_enc16(const unsigned char *src, char *dst) {
+    __m128i in = _mm_loadu_si128((const __m128i *)src);
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    // Split every 3 bytes into four 6-bit indices
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i idx = _mm_or_si128(t0, t1);
+    // Map the indices to ASCII by adding a per-range offset
+    __m128i range = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+    range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m128i out = _mm_add_epi8(_mm_shuffle_epi8(offsets, range), idx);
+    _mm_storeu_si128((__m128i *)dst, out);
+}
+#endif
+
+static char *jsb_base64_encode(char *out, const unsigned char *src, size_t len) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    for (; i + 16 <= len; i += 12) {
+        jsb_base64_enc16(src + i, out);
+        out += 16;
+    }
+#endif
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = (uint32_t)src[i] << 16 | (uint32_t)src[i + 1] << 8 | src[i + 2];
+        out[0] = jsb_base64_chars[v >> 18];
+        out[1] = jsb_base64_chars[(v >> 12) & 0x3F];
+        out[2] = jsb_base64_chars[(v >> 6) & 0x3F];
+        out[3] = jsb_base64_chars[v & 0x3F];
+        out += 4;
+    }
+    if (i < len) {
+        uint32_t v = (uint32_t)src[i] << 16 | (i + 1 < len ? (uint32_t)src[i + 1] << 8 : 0);
+        out[0] = jsb_base64_chars[v >> 18];
+        out[1] = jsb_base64_chars[(v >> 12) & 0x3F];
+        out[2] = i + 1 < len ? jsb_base64_chars[(v >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return out;
+}
+
+int jsb_base64(Jsb *jsb, const void *data, size_t len) {
+    if (!data) return jsb_null(jsb);
+    if (jsb_check_val(jsb)) return -1;
+    if (len > (SIZE_MAX - 8) / 4 * 3) return -1;
+    size_t n = (len + 2) / 3 * 4;
+    if (jsb_prefix(jsb, !jsb->is_first, n + 2)) return -1;
+    char *out = jsb->buffer.items + jsb->buffer.count;
+    *out++ = '"';
+    out = jsb_base64_encode(out, data, len);
+    *out++ = '"';
+    *out = '\0';
+    jsb->buffer.count = out - jsb->buffer.items;
+    jsb->is_first = false;
+    jsb->is_key = false;
+    return 0;
+}
+
+JsbMark jsb_mark(Jsb *jsb) {
+    return (JsbMark){
+        .offset = jsb->buffer.flushed + jsb->buffer.count,
+        .level = jsb->level,
+        .state = jsb->state[jsb->level],
+        .is_first = jsb->is_first,
+        .is_key = jsb->is_key,
+    };
+}
+
+int jsb_rollback(Jsb *jsb, JsbMark mark) {
+    if (jsb_failed(jsb) || mark.offset < jsb->buffer.flushed) return -1;
+    size_t count = mark.offset - jsb->buffer.flushed;
+    if (count > jsb->buffer.count || mark.level < 0 || mark.level > jsb->level) return -1;
+    jsb->buffer.count = count;
+    if (jsb->buffer.items) jsb->buffer.items[count] = '\0';
+    jsb->level = mark.level;
+    jsb->state[mark.level] = mark.state;
+    jsb->is_first = mark.is_first;
+    jsb->is_key = mark.is_key;
+    struct jsb_canon *c = jsb->canon;
+    if (jsb->canonical && c) {
+        while (c->count > 0 && c->entries[c->count - 1] >= count)
+            c->count--;
+        c->objects = 0;
+        for (int i = 1; i <= jsb->level; ++i)
+            c->objects += jsb->state[i] == JSB_STATE_OBJECT;
+        // Hashed output was discarded, hash again from the start of the value
+        if (c->hashed > mark.offset) {
+            c->hashed = c->start;
+            jsb_hash_init(&c->hash, 0);
+        }
+    }
+    return 0;
+}
+
+static JsbCacheEntry *jsb_cache_slot(JsbCache *cache, const void *obj) {
+    uint64_t h = (uint64_t)(uintptr_t)obj * 0x9E3779B97F4A7C15ULL;
+    return &cache->entries[(h >> 32) % JSB_CACHE_SIZE];
+}
+
+int jsb_cache_get(Jsb *jsb, JsbCache *cache, const void *obj, uint64_t version) {
+    JsbCacheEntry *e = jsb_cache_slot(cache, obj);
+    if (!e->json || e->obj != obj || e->version != version) return 0;
+    if (e->level != jsb->level || e->pp != jsb->pp || e->ascii != jsb->ascii ||
+        e->canonical != jsb->canonical)
+        return 0;
+    return jsb_raw(jsb, e->json, e->len) ? -1 : 1;
+}
+
+int jsb_cache_put(Jsb *jsb, JsbCache *cache, const void *obj, uint64_t version, size_t start) {
+    if (jsb_failed(jsb)) return -1;
+    // Part of the value may already be flushed to the sink
+    if (start < jsb->buffer.flushed) return 0;
+    start -= jsb->buffer.flushed;
+    if (start > jsb->buffer.count) return -1;
+    // Skip the separator and indentation written before the value
+    const char *json = jsb->buffer.items + start;
+    size_t len = jsb->buffer.count - start;
+    while (len && (*json == ',' || *json == '\n' || *json == ' ')) {
+        json++;
+        len--;
+    }
+    if (!len) return -1;
+    JsbCacheEntry *e = jsb_cache_slot(cache, obj);
+    char *copy = JSB_REALLOC(e->json, len);
+    if (!copy) return -1;
+    memcpy(copy, json, len);
+    *e = (JsbCacheEntry){obj, version, jsb->level, jsb->pp, jsb->ascii, jsb->canonical, copy, len};
+    return 0;
+}
+
+void jsb_cache_free(JsbCache *cache) {
+    for (size_t i = 0; i < JSB_CACHE_SIZE; ++i) {
+        if (cache->entries[i].json) JSB_FREE(cache->entries[i].json);
+        cache->entries[i] = (JsbCacheEntry){0};
+    }
+}
+
+#ifdef JSB_THREADS
+typedef struct {
+    Jsb jsb;
+    JsbItemFn fn;
+    void *ctx;
+    size_t begin;
+    size_t end;
+    int err;
+} JsbChunk;
+
+static void *jsb_chunk_run(void *arg) {
+    JsbChunk *c = arg;
+    for (size_t i = c->begin; i < c->end && !c->err; ++i) {
+        if (c->fn(&c->jsb, i, c->ctx)) c->err = -1;
+    }
+    if (jsb_failed(&c->jsb)) c->err = -1;
+    return NULL;
+}
+
+static int jsb_parallel_chunks(Jsb *jsb, size_t count, JsbItemFn fn, void *ctx, int threads) {
+    JsbChunk *chunks = JSB_REALLOC(NULL, threads * sizeof(*chunks));
+    pthread_t *tids = JSB_REALLOC(NULL, threads * sizeof(*tids));
+    if (!chunks || !tids) {
+        JSB_FREE(chunks);
+        JSB_FREE(tids);
+        return -1;
+    }
+    int started = 0, err = 0;
+    for (int t = 0; t < threads; ++t) {
+        JsbChunk *c = &chunks[t];
+        *c = (JsbChunk){.fn = fn, .ctx = ctx, .begin = count * t / threads, .end = count * (t + 1) / threads};
+        c->jsb.pp = jsb->pp;
+        c->jsb.ascii = jsb->ascii;
+        c->jsb.ndjson = jsb->ndjson;
+        c->jsb.canonical = jsb->canonical;
+        c->jsb.level = jsb->level;
+        memcpy(c->jsb.state, jsb->state, (jsb->level + 1) * sizeof(JsbState));
+        // Only the first chunk can be at the beginning of the array
+        c->jsb.is_first = t == 0 ? jsb->is_first : false;
+        // The first chunk runs on this thread
+        if (t > 0 && pthread_create(&tids[t], NULL, jsb_chunk_run, c) != 0) break;
+        started++;
+    }
+    if (started < threads) err = -1;
+    else jsb_chunk_run(&chunks[0]);
+    for (int t = 0; t < started; ++t) {
+        if (t > 0) pthread_join(tids[t], NULL);
+        JsbChunk *c = &chunks[t];
+        // Through the parent sink, each chunk is released once written
+        if (c->err || err || jsb_sappendn(&jsb->buffer, c->jsb.buffer.items, c->jsb.buffer.count)) err = -1;
+        jsb_free(&c->jsb);
+    }
+    JSB_FREE(chunks);
+    JSB_FREE(tids);
+    if (err) return -1;
     jsb->is_first = false;
     jsb->is_key = false;
     return 0;
 }
+#endif
+
+int jsb_parallel_array(Jsb *jsb, size_t count, JsbItemFn fn, void *ctx, int threads) {
+    if (jsb_failed(jsb) || jsb->state[jsb->level] != JSB_STATE_ARRAY) return -1;
+#ifdef JSB_THREADS
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if ((size_t)threads > count / 2) threads = (int)(count / 2);
+    if (threads >= 2) return jsb_parallel_chunks(jsb, count, fn, ctx, threads);
+#else
+    (void)threads;
+#endif
+    for (size_t i = 0; i < count; ++i) {
+        if (fn(jsb, i, ctx)) return -1;
+    }
+    return jsb_failed(jsb) ? -1 : 0;
+}
 
 int jsb_date_fmt(Jsb *jsb, time_t timestamp, const char *fmt) {
     if (jsb_check_val(jsb)) return -1;
-    if (!jsb->is_first) jsb_sappend(&jsb->buffer, ',');
-    jsb_pretty_print_ch(jsb);
+    char datebuf[64];
+    struct tm tm_info;
+#ifdef _WIN32
+    if (localtime_s(&tm_info, &timestamp)) return -1;
+#else
+    if (!localtime_r(&timestamp, &tm_info)) return -1;
+#endif
+    size_t n = strftime(datebuf, sizeof(datebuf), fmt, &tm_info);
+    if (jsb_prefix(jsb, !jsb->is_first, n + 2)) return -1;
+    jsb_escaped_nstring(&jsb->buffer, datebuf, n, false, 0);
+    jsb->is_first = false;
+    jsb->is_key = false;
+    return jsb_failed(jsb) ? -1 : 0;
+}
+
+/**
+ * Formats the day number since 1970-01-01 as "YYYY-MM-DD" into out.
+ * The last formatted day is cached per thread, timestamps in a stream
+ * mostly share the same date prefix.
+ * Returns 0 on success, -1 if the year is outside 0000-9999.
+ */
+static int jsb_civil_date(int64_t days, char *out) {
+    static JSB_THREAD_LOCAL int64_t cached_days = INT64_MIN;
+    static JSB_THREAD_LOCAL char cached[10];
+    if (days != cached_days) {
+        // civil_from_days, see https://howardhinnant.github.io/date_algorithms.html
+        int64_t z = days + 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        int64_t doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        int64_t d = doy - (153 * mp + 2) / 5 + 1;
+        int64_t m = mp < 10 ? mp + 3 : mp - 9;
+        int64_t y = yoe + era * 400 + (m <= 2);
+        if (y < 0 || y > 9999) return -1;
+        memcpy(cached, jsb_digit_pairs + (y / 100) * 2, 2);
+        memcpy(cached + 2, jsb_digit_pairs + (y % 100) * 2, 2);
+        cached[4] = '-';
+        memcpy(cached + 5, jsb_digit_pairs + m * 2, 2);
+        cached[7] = '-';
+        memcpy(cached + 8, jsb_digit_pairs + d * 2, 2);
+        cached_days = days;
+    }
+    memcpy(out, cached, 10);
+    return 0;
+}
+
+int jsb_date_utc(Jsb *jsb, int64_t timestamp, uint32_t usec, JsbDatePrecision precision) {
+    if (usec >= 1000000) return -1;
+    if (jsb_check_val(jsb)) return -1;
+    int64_t days = timestamp / 86400;
+    int64_t secs = timestamp % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        days--;
+    }
     char datebuf[32];
-    struct tm *tm_info = localtime((time_t *)&timestamp);
-    strftime(datebuf, sizeof(datebuf), fmt, tm_info);
-    jsb_escaped_string(&jsb->buffer, datebuf);
+    char *out = datebuf;
+    *out++ = '"';
+    if (jsb_civil_date(days, out)) return -1;
+    out += 10;
+    if (precision != JSB_DATE_DAY) {
+        *out++ = 'T';
+        memcpy(out, jsb_digit_pairs + (secs / 3600) * 2, 2);
+        out[2] = ':';
+        memcpy(out + 3, jsb_digit_pairs + (secs / 60 % 60) * 2, 2);
+        out[5] = ':';
+        memcpy(out + 6, jsb_digit_pairs + (secs % 60) * 2, 2);
+        out += 8;
+        if (precision == JSB_DATE_MILLIS) {
+            uint32_t ms = usec / 1000;
+            *out++ = '.';
+            *out++ = (char)('0' + ms / 100);
+            memcpy(out, jsb_digit_pairs + (ms % 100) * 2, 2);
+            out += 2;
+        } else if (precision == JSB_DATE_MICROS) {
+            *out++ = '.';
+            memcpy(out, jsb_digit_pairs + (usec / 10000) * 2, 2);
+            memcpy(out + 2, jsb_digit_pairs + (usec / 100 % 100) * 2, 2);
+            memcpy(out + 4, jsb_digit_pairs + (usec % 100) * 2, 2);
+            out += 6;
+        }
+        *out++ = 'Z';
+    }
+    *out++ = '"';
+
+    if (jsb_emit(jsb, !jsb->is_first, datebuf, out - datebuf)) return -1;
     jsb->is_first = false;
     jsb->is_key = false;
     return 0;
 }
+
+int jsb_datetime_ms(Jsb *jsb, int64_t millis) {
+    int64_t secs = millis / 1000;
+    int64_t rem = millis % 1000;
+    if (rem < 0) {
+        rem += 1000;
+        secs--;
+    }
+    return jsb_date_utc(jsb, secs, (uint32_t)rem * 1000, JSB_DATE_MILLIS);
+}
+
+int jsb_datetime_us(Jsb *jsb, int64_t micros) {
+    int64_t secs = micros / 1000000;
+    int64_t rem = micros % 1000000;
+    if (rem < 0) {
+        rem += 1000000;
+        secs--;
+    }
+    return jsb_date_utc(jsb, secs, (uint32_t)rem, JSB_DATE_MICROS);
+}
 #endif // JSB_IMPLEMENTATION
 #endif // JSB_H_
\ No newline at end of file
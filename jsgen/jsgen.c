@@ -64,6 +64,8 @@ const char *get_jsp_type(const char *type) {
     if (strcmp(type, "double") == 0) return "number";
     if (strcmp(type, "long") == 0) return "number";
     if (strcmp(type, "size_t") == 0) return "number";
+    if (strcmp(type, "int64_t") == 0) return "number";
+    if (strcmp(type, "uint64_t") == 0) return "number";
     if (strcmp(type, "bool") == 0) return "boolean";
     if (strcmp(type, "char*") == 0) return "string";
     int len = strlen(type);
@@ -78,10 +80,12 @@ const char *get_jsp_type(const char *type) {
 
 const char *get_jsb_type(const char *type) {
     if (strcmp(type, "int") == 0) return "int";
-    if (strcmp(type, "float") == 0) return "number";
-    if (strcmp(type, "double") == 0) return "number";
-    if (strcmp(type, "long") == 0) return "int";
-    if (strcmp(type, "size_t") == 0) return "int";
+    if (strcmp(type, "float") == 0) return "float";
+    if (strcmp(type, "double") == 0) return "double";
+    if (strcmp(type, "long") == 0) return "int64";
+    if (strcmp(type, "size_t") == 0) return "uint64";
+    if (strcmp(type, "int64_t") == 0) return "int64";
+    if (strcmp(type, "uint64_t") == 0) return "uint64";
     if (strcmp(type, "bool") == 0) return "bool";
     if (strcmp(type, "char*") == 0) return "string";
     int len = strlen(type);
@@ -94,6 +98,14 @@ const char *get_jsb_type(const char *type) {
     return NULL;
 }
 
+// Keys made of printable ASCII without quotes or backslashes can be emitted with JSB_KEY
+bool is_plain_key(const char *key) {
+    for (const char *c = key; *c; ++c) {
+        if (*c < 0x20 || *c > 0x7E || *c == '"' || *c == '\\') return false;
+    }
+    return true;
+}
+
 void post_process_model(Model *model) {
     for (size_t i = 0; i < model->fields.count; ++i) {
         Field *field = &model->fields.items[i];
@@ -340,22 +352,17 @@ void gen_stringify_field(StringBuilder *sb, Field *field, int indent) {
         indent++;
     }
 
-    sb_cat_line(sb, indent, "if (jsb_key(jsb, \"", js_getalias(field), "\")) return -1;");
+    if (is_plain_key(js_getalias(field)))
+        sb_cat_line(sb, indent, "if (jsb_key_tok(jsb, JSB_KEY(\"", js_getalias(field), "\"))) return -1;");
+    else
+        sb_cat_line(sb, indent, "if (jsb_key(jsb, \"", js_getalias(field), "\")) return -1;");
     const char *jsb_type = get_jsb_type(field->type);
 
     if (jsb_type) {
         if (field->is_json_literal) {
-            sb_cat_line(sb, indent, "size_t plen = in->", field->name, " ? strlen(in->", field->name, ") : 0;");
-            sb_cat_line(sb, indent, "if (plen > 0) {");
-            sb_cat_line(sb, indent + 1, "jsb_srealloc(&jsb->buffer, jsb->buffer.count + plen + 1);");
-            sb_cat_line(sb, indent + 1, "memcpy(jsb->buffer.items + jsb->buffer.count, in->", field->name, ", plen);");
-            sb_cat_line(sb, indent + 1, "jsb->buffer.count += plen;");
-            sb_cat_line(sb, indent + 1, "jsb->buffer.items[jsb->buffer.count] = '\\0';");
-            sb_cat_line(sb, indent + 1, "jsb->is_first = false;");
-            sb_cat_line(sb, indent + 1, "jsb->is_key = false;");
-            sb_cat_line(sb, indent, "} else jsb_null(jsb);");
+            sb_cat_line(sb, indent, "if (jsb_raw(jsb, in->", field->name, ", in->", field->name, " ? strlen(in->", field->name, ") : 0)) return -1;");
         } else {
-            sb_cat_line(sb, indent, "if (jsb_", jsb_type, "(jsb, in->", field->name, (strcmp(jsb_type, "number") == 0 ? ", 5" : ""), ")) return -1;");
+            sb_cat_line(sb, indent, "if (jsb_", jsb_type, "(jsb, in->", field->name, ")) return -1;");
         }
     } else if (field->is_array) {
         sb_cat_line(sb, indent, "if (jsb_begin_array(jsb)) return -1;");
@@ -479,12 +486,15 @@ void generate_model_code(StringBuilder *sb, Model *model) {
 
         sb_cat_line(sb, indent, "char* stringify_", model->simple_name, "_indent(", model->name, " *in, int indent) {");
         indent++;
-        sb_cat_line(sb, indent, "Jsb jsb = {.pp = indent};");
-        sb_cat_line(sb, indent, "if(_stringify_", model->simple_name, "(&jsb, in)) {");
-        sb_cat_line(sb, indent + 1, "jsb_free(&jsb);");
+        sb_cat_line(sb, indent, "static JSB_THREAD_LOCAL size_t size_hint = 0;");
+        sb_cat_line(sb, indent, "Jsb *jsb = jsb_pool_acquire(size_hint);");
+        sb_cat_line(sb, indent, "if (!jsb) return NULL;");
+        sb_cat_line(sb, indent, "jsb->pp = indent;");
+        sb_cat_line(sb, indent, "if (_stringify_", model->simple_name, "(jsb, in)) {");
+        sb_cat_line(sb, indent + 1, "jsb_pool_release(jsb, &size_hint);");
         sb_cat_line(sb, indent + 1, "return NULL;");
         sb_cat_line(sb, indent, "}");
-        sb_cat_line(sb, indent, "return jsb_get(&jsb);");
+        sb_cat_line(sb, indent, "return jsb_pool_take(jsb, &size_hint);");
         indent--;
         sb_cat_line(sb, indent, "}");
         sb_append(sb, "\n");
@@ -492,20 +502,66 @@ void generate_model_code(StringBuilder *sb, Model *model) {
         sb_cat_line(sb, indent, "#define stringify_", model->simple_name, "(in) stringify_", model->simple_name, "_indent((in), 0)");
         sb_append(sb, "\n");
 
-        sb_cat_line(sb, indent, "char* stringify_", model->simple_name, "_list_indent(", model->name, " *in, size_t count, int indent) {");
+        sb_cat_line(sb, indent, "size_t stringify_", model->simple_name, "_length(", model->name, " *in, int indent) {");
+        indent++;
+        sb_cat_line(sb, indent, "Jsb *jsb = jsb_pool_acquire(0);");
+        sb_cat_line(sb, indent, "if (!jsb) return 0;");
+        sb_cat_line(sb, indent, "jsb->pp = indent;");
+        sb_cat_line(sb, indent, "jsb_init_count(jsb);");
+        sb_cat_line(sb, indent, "size_t len = _stringify_", model->simple_name, "(jsb, in) ? 0 : jsb_length(jsb);");
+        sb_cat_line(sb, indent, "jsb_pool_release(jsb, NULL);");
+        sb_cat_line(sb, indent, "return len;");
+        indent--;
+        sb_cat_line(sb, indent, "}");
+        sb_append(sb, "\n");
+
+        sb_cat_line(sb, indent, "int stringify_", model->simple_name, "_into(", model->name, " *in, char *buf, size_t size, int indent) {");
         indent++;
         sb_cat_line(sb, indent, "Jsb jsb = {.pp = indent};");
-        sb_cat_line(sb, indent, "if (jsb_begin_array(&jsb)) return NULL;");
-        sb_cat_line(sb, indent, "for (size_t i = 0; i < count; i++) {");
-        sb_cat_line(sb, indent + 1, "if (_stringify_", model->simple_name, "(&jsb, &in[i])) return NULL;");
+        sb_cat_line(sb, indent, "jsb_init_buffer(&jsb, buf, size, false);");
+        sb_cat_line(sb, indent, "int err = _stringify_", model->simple_name, "(&jsb, in);");
+        sb_cat_line(sb, indent, "jsb_free(&jsb);");
+        sb_cat_line(sb, indent, "return err;");
+        indent--;
         sb_cat_line(sb, indent, "}");
-        sb_cat_line(sb, indent, "if (jsb_end_array(&jsb)) return NULL;");
-        sb_cat_line(sb, indent, "return jsb_get(&jsb);");
+        sb_append(sb, "\n");
+
+        sb_cat_line(sb, indent, "char* stringify_", model->simple_name, "_list_indent(", model->name, " *in, size_t count, int indent) {");
+        indent++;
+        sb_cat_line(sb, indent, "static JSB_THREAD_LOCAL size_t size_hint = 0;");
+        sb_cat_line(sb, indent, "Jsb *jsb = jsb_pool_acquire(size_hint);");
+        sb_cat_line(sb, indent, "if (!jsb) return NULL;");
+        sb_cat_line(sb, indent, "jsb->pp = indent;");
+        sb_cat_line(sb, indent, "int err = jsb_begin_array(jsb);");
+        sb_cat_line(sb, indent, "for (size_t i = 0; i < count && !err; i++) {");
+        sb_cat_line(sb, indent + 1, "err = _stringify_", model->simple_name, "(jsb, &in[i]);");
+        sb_cat_line(sb, indent, "}");
+        sb_cat_line(sb, indent, "if (err || jsb_end_array(jsb)) {");
+        sb_cat_line(sb, indent + 1, "jsb_pool_release(jsb, &size_hint);");
+        sb_cat_line(sb, indent + 1, "return NULL;");
+        sb_cat_line(sb, indent, "}");
+        sb_cat_line(sb, indent, "return jsb_pool_take(jsb, &size_hint);");
         indent--;
         sb_cat_line(sb, indent, "}");
         sb_append(sb, "\n");
         sb_cat_line(sb, indent, "#define stringify_", model->simple_name, "_list(in, count) stringify_", model->simple_name, "_list_indent((in), (count), 0)");
         sb_append(sb, "\n");
+
+        sb_cat_line(sb, indent, "static int _stringify_", model->simple_name, "_item(Jsb *jsb, size_t i, void *ctx) {");
+        sb_cat_line(sb, indent + 1, "return _stringify_", model->simple_name, "(jsb, &((", model->name, " *)ctx)[i]);");
+        sb_cat_line(sb, indent, "}");
+        sb_append(sb, "\n");
+        sb_cat_line(sb, indent, "char* stringify_", model->simple_name, "_list_parallel(", model->name, " *in, size_t count, int indent, int threads) {");
+        indent++;
+        sb_cat_line(sb, indent, "Jsb jsb = {.pp = indent};");
+        sb_cat_line(sb, indent, "if (jsb_begin_array(&jsb) || jsb_parallel_array(&jsb, count, _stringify_", model->simple_name, "_item, in, threads) || jsb_end_array(&jsb)) {");
+        sb_cat_line(sb, indent + 1, "jsb_free(&jsb);");
+        sb_cat_line(sb, indent + 1, "return NULL;");
+        sb_cat_line(sb, indent, "}");
+        sb_cat_line(sb, indent, "return jsb_get(&jsb);");
+        indent--;
+        sb_cat_line(sb, indent, "}");
+        sb_append(sb, "\n");
     }
 }
 
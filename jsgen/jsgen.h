@@ -28,6 +28,14 @@ JSON typedef struct {
     printf("User as JSON: %s\n", json_str);
     jsgen_free(&a);
     free(json_str);
+```
+ * stringify_User builds once with a builder pooled per thread and hands its buffer over, a single
+ * allocation once the thread's size hint has grown to the output size (the first calls on a thread
+ * may reallocate). For exactly one allocation of the exact size, serialize twice instead:
+```c
+    size_t len = stringify_User_length(&user, 0);
+    char *json_str = malloc(len + 1);
+    stringify_User_into(&user, json_str, len + 1, 0);
 ```
  */
 #ifndef JSGEN_H
@@ -47,10 +47,14 @@ const char *json = "{\"name\": \"John\", \"age\": 30, \"is_student\": false, \"a
 #define JSP_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 
 #define JSP_SMIN_CAPACITY 32
 #ifndef JSP_MAX_NESTING
@@ -143,6 +147,20 @@ int jsp_key(Jsp *jsp);
  * Returns 0 on success, -1 on failure.
  */
 int jsp_value(Jsp *jsp);
+/**
+ * Try parse a base64 string value (standard alphabet, padding optional) and decode it into out.
+ * len is set to the decoded size. With out NULL only len is set and the value is not consumed,
+ * so it can be sized first:
+```c
+    size_t len;
+    if (jsp_value_base64(&jsp, NULL, 0, &len)) ...
+    void *data = jsgen_malloc(&a, len);
+    if (jsp_value_base64(&jsp, data, len, &len)) ...
+```
+ * If capacity is too small the value is not consumed either and -1 is returned with len set to the needed size.
+ * Returns 0 on success, -1 on failure.
+ */
+int jsp_value_base64(Jsp *jsp, void *out, size_t capacity, size_t *len);
 /**
  * Free JSP resources.
  */
@@ -236,7 +254,13 @@ static int jsp_parse_str(Jsp *jsp) {
                 jsp_sappend(&jsp->_sb, '\n');
             } else if (jsp->buffer[idx] == 't') {
                 jsp_sappend(&jsp->_sb, '\t');
-            } else if (jsp->buffer[idx] == '\\' || jsp->buffer[idx] == '"') {
+            } else if (jsp->buffer[idx] == 'r') {
+                jsp_sappend(&jsp->_sb, '\r');
+            } else if (jsp->buffer[idx] == 'b') {
+                jsp_sappend(&jsp->_sb, '\b');
+            } else if (jsp->buffer[idx] == 'f') {
+                jsp_sappend(&jsp->_sb, '\f');
+            } else if (jsp->buffer[idx] == '\\' || jsp->buffer[idx] == '"' || jsp->buffer[idx] == '/') {
                 jsp_sappend(&jsp->_sb, jsp->buffer[idx]);
             } else if (jsp->buffer[idx] == 'u') {
                 // Unicode escape \uXXXX
@@ -478,6 +502,130 @@ int jsp_skip(Jsp *jsp) {
     return ret;
 }
 
+static const int8_t jsp_base64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+#if defined(__SSSE3__)
+/**
+ * Decodes 16 characters into 12 bytes, writing 16 bytes to dst.
+ * See http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html
+ * Returns 0 on success, -1 on invalid characters.
+ */
+static int jsp_base64_dec16(const char *src, unsigned char *dst) {
+    __m128i in = _mm_loadu_si128((const __m128i *)src);
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    // Valid ranges and offsets by high nibble: +/ 0-9 A-O P-Z a-o p-z
+    const __m128i lower = _mm_setr_epi8(1, 1, 0x2b, 0x30, 0x41, 0x50, 0x61, 0x70, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i upper = _mm_setr_epi8(0, 0, 0x2b, 0x39, 0x4f, 0x5a, 0x6f, 0x7a, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i shift = _mm_setr_epi8(0, 0, 0x3e - 0x2b, 0x34 - 0x30, 0x00 - 0x41, 0x0f - 0x50, 0x1a - 0x61, 0x29 - 0x70,
+                                        0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i below = _mm_cmplt_epi8(in, _mm_shuffle_epi8(lower, hi));
+    __m128i above = _mm_cmpgt_epi8(in, _mm_shuffle_epi8(upper, hi));
+    __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    if (_mm_movemask_epi8(_mm_andnot_si128(slash, _mm_or_si128(below, above)))) return -1;
+    __m128i values = _mm_add_epi8(in, _mm_shuffle_epi8(shift, hi));
+    values = _mm_add_epi8(values, _mm_and_si128(slash, _mm_set1_epi8(-3)));
+    // Pack four 6-bit values into 3 bytes
+    __m128i ab = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i abcd = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+    abcd = _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128((__m128i *)dst, abcd);
+    return 0;
+}
+#endif
+
+/**
+ * Decodes n base64 characters (padding excluded) into out, that has room for the decoded size.
+ * Returns 0 on success, -1 on invalid input.
+ */
+static int jsp_base64_decode(unsigned char *out, size_t capacity, const char *src, size_t n) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // The vector store writes 16 bytes for 12
+    for (; i + 16 <= n && (i / 4) * 3 + 16 <= capacity; i += 16) {
+        if (jsp_base64_dec16(src + i, out)) return -1;
+        out += 12;
+    }
+#else
+    (void)capacity;
+#endif
+    const int8_t *values = jsp_base64_values;
+    for (; i + 4 <= n; i += 4) {
+        int a = values[(unsigned char)src[i]], b = values[(unsigned char)src[i + 1]];
+        int c = values[(unsigned char)src[i + 2]], d = values[(unsigned char)src[i + 3]];
+        // Any invalid character (-1) makes the OR negative
+        if ((a | b | c | d) < 0) return -1;
+        uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+        out[0] = (unsigned char)(v >> 16);
+        out[1] = (unsigned char)(v >> 8);
+        out[2] = (unsigned char)v;
+        out += 3;
+    }
+    size_t rest = n - i;
+    if (rest == 1) return -1;
+    if (rest) {
+        int a = values[(unsigned char)src[i]], b = values[(unsigned char)src[i + 1]];
+        int c = rest == 3 ? values[(unsigned char)src[i + 2]] : 0;
+        if ((a | b | c) < 0) return -1;
+        uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6;
+        *out++ = (unsigned char)(v >> 16);
+        if (rest == 3) *out++ = (unsigned char)(v >> 8);
+    }
+    return 0;
+}
+
+int jsp_value_base64(Jsp *jsp, void *out, size_t capacity, size_t *len) {
+    if (jsp->state[jsp->level] != JSP_KEY && jsp->state[jsp->level] != JSP_ARRAY) return -1;
+    if (jsp->off >= jsp->length || jsp->buffer[jsp->off] != '"') return -1;
+    size_t off = jsp->off;
+    const char *src = jsp->buffer + off + 1;
+    const char *end = memchr(src, '"', jsp->length - off - 1);
+    if (!end) return -1;
+    size_t n = end - src;
+    size_t next = end + 1 - jsp->buffer;
+    if (memchr(src, '\\', n)) {
+        // The slash may be escaped as \/, the only escape that can appear in base64
+        jsp_srealloc(&jsp->_sb, n + 1);
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (src[i] == '\\' && (++i == n || src[i] != '/')) return -1;
+            jsp->_sb.items[count++] = src[i];
+        }
+        jsp->_sb.count = count;
+        src = jsp->_sb.items;
+        n = count;
+    }
+    // At most two padding characters, any other '=' is rejected by the decoder
+    for (int pad = 0; pad < 2 && n && src[n - 1] == '='; ++pad)
+        n--;
+    size_t size = n / 4 * 3 + (n % 4 ? n % 4 - 1 : 0);
+    if (len) *len = size;
+    if (!out) return 0;
+    if (size > capacity) return -1;
+    if (jsp_base64_decode(out, capacity, src, n)) return -1;
+    jsp_zero_ret(jsp);
+    jsp->type = JSP_TYPE_STRING;
+    jsp->off = next;
+    if (jsp->state[jsp->level] == JSP_KEY) jsp->level--;
+    return jsp_skip_end(jsp);
+}
+
 void jsp_free(Jsp *jsp) {
     if (jsp->_sb.items) {
         JSP_FREE(jsp->_sb.items);
@@ -0,0 +1,464 @@
+/**
+ * Simple MessagePack builder, with the same API shape as jsb.h
+ * https://github.com/mceck/c-stb
+ *
+ * Example:
+```c
+#define MPB_IMPLEMENTATION
+#include "mpb.h"
+...
+    Mpb mpb = {0};
+    mpb_begin_object(&mpb);
+    {
+        mpb_key(&mpb, "message");
+        mpb_string(&mpb, "Hello, World!");
+        mpb_key(&mpb, "data");
+        mpb_begin_array(&mpb);
+        {
+            mpb_int(&mpb, 2);
+            mpb_double(&mpb, 2.432);
+            mpb_bool(&mpb, true);
+            mpb_null(&mpb);
+        }
+        mpb_end_array(&mpb);
+    }
+    mpb_end_object(&mpb);
+    send(fd, mpb_get(&mpb), mpb_len(&mpb), 0);
+    mpb_free(&mpb);
+```
+ *
+ * Container sizes are not known in advance: begin writes a 32-bit header that end
+ * back-patches with the element count, then shrinks to the smallest encoding
+ * (fixmap/fixarray or 16-bit) by moving the body down.
+ */
+
+#ifndef MPB_H_
+#define MPB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MPB_REALLOC
+#define MPB_REALLOC realloc
+#endif
+#ifndef MPB_FREE
+#define MPB_FREE free
+#endif
+
+#ifndef MPB_MAX_NESTING
+#define MPB_MAX_NESTING 64
+#endif
+
+#define MPB_SMIN_CAPACITY 32
+
+typedef enum {
+    MPB_STATE_START,
+    MPB_STATE_ARRAY,
+    MPB_STATE_OBJECT,
+    MPB_STATE_END
+} MpbState;
+
+struct mpb_string {
+    unsigned char *items;
+    size_t count;
+    size_t capacity;
+    bool failed; // an allocation failed
+};
+
+typedef struct {
+    struct mpb_string buffer;
+    MpbState state[MPB_MAX_NESTING];
+    size_t header[MPB_MAX_NESTING]; // offset of the container header
+    uint32_t count[MPB_MAX_NESTING]; // elements (arrays) or keys (objects) so far
+    int level;
+    bool is_first;
+    bool is_key;
+} Mpb;
+
+#define mpb_free(mpb)                                 \
+    do {                                              \
+        if ((mpb)->buffer.items) {                    \
+            MPB_FREE((mpb)->buffer.items);            \
+        }                                             \
+        (mpb)->buffer.items = NULL;                   \
+        (mpb)->buffer.count = 0;                      \
+        (mpb)->buffer.capacity = 0;                   \
+        (mpb)->buffer.failed = false;                 \
+    } while (0)
+
+/**
+ * True if the output is incomplete because an allocation failed.
+ */
+#define mpb_failed(mpb) ((mpb)->buffer.failed)
+
+/**
+ * Begin a map.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_begin_object(Mpb *mpb);
+/**
+ * End a map.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_end_object(Mpb *mpb);
+/**
+ * Begin an array.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_begin_array(Mpb *mpb);
+/**
+ * End an array.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_end_array(Mpb *mpb);
+/**
+ * Add a string key to the current map.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_key(Mpb *mpb, const char *key);
+/**
+ * Add a string value of len bytes, NULL adds nil.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_nstring(Mpb *mpb, const char *str, size_t len);
+#define mpb_string(mpb, str) mpb_nstring(mpb, str, (str) ? strlen(str) : 0)
+/**
+ * Add a binary value.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_bin(Mpb *mpb, const void *data, size_t len);
+/**
+ * Add an integer value in its smallest encoding.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_int(Mpb *mpb, int value);
+int mpb_int64(Mpb *mpb, int64_t value);
+int mpb_uint64(Mpb *mpb, uint64_t value);
+/**
+ * Add a float64 value.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_double(Mpb *mpb, double value);
+/**
+ * Add a float32 value.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_float(Mpb *mpb, float value);
+/**
+ * Add a boolean value.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_bool(Mpb *mpb, bool value);
+/**
+ * Add a timestamp extension value (type -1), nsec is the sub-second part in nanoseconds.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_timestamp(Mpb *mpb, int64_t timestamp, uint32_t nsec);
+/**
+ * Add a nil value.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpb_null(Mpb *mpb);
+
+#define mpb_get(mpb) ((const char *)(mpb)->buffer.items)
+#define mpb_len(mpb) ((mpb)->buffer.count)
+
+#ifdef MPB_IMPLEMENTATION
+
+static int mpb_srealloc(struct mpb_string *sb, size_t new_capacity) {
+    if (sb->failed) return -1;
+    if (new_capacity <= sb->capacity) return 0;
+    size_t cap = sb->capacity ? sb->capacity : MPB_SMIN_CAPACITY;
+    while (cap < new_capacity)
+        cap *= 2;
+    unsigned char *items = MPB_REALLOC(sb->items, cap);
+    if (!items) {
+        sb->failed = true;
+        return -1;
+    }
+    sb->items = items;
+    sb->capacity = cap;
+    return 0;
+}
+
+static unsigned char *mpb_put_be(unsigned char *out, uint64_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = (unsigned char)v;
+        v >>= 8;
+    }
+    return out + bytes;
+}
+
+/**
+ * Values are valid only in:
+ * beginning of the document
+ * map context after a key
+ * array context
+ */
+static int mpb_check_val(Mpb *mpb) {
+    if (mpb->buffer.failed) return -1;
+    MpbState state = mpb->state[mpb->level];
+    if (state == MPB_STATE_ARRAY) return 0;
+    if (state == MPB_STATE_OBJECT && mpb->is_key) return 0;
+    if (state == MPB_STATE_START && mpb->is_first) return 0;
+    return -1;
+}
+
+static void mpb_counted(Mpb *mpb) {
+    if (mpb->state[mpb->level] == MPB_STATE_ARRAY) mpb->count[mpb->level]++;
+    mpb->is_first = false;
+    mpb->is_key = false;
+}
+
+/**
+ * Reserves len bytes for a value.
+ * Returns where to write them, NULL on failure.
+ */
+static unsigned char *mpb_reserve(Mpb *mpb, size_t len) {
+    if (mpb_check_val(mpb)) return NULL;
+    if (mpb_srealloc(&mpb->buffer, mpb->buffer.count + len)) return NULL;
+    return mpb->buffer.items + mpb->buffer.count;
+}
+
+static int mpb_commit(Mpb *mpb, unsigned char *end) {
+    mpb->buffer.count = end - mpb->buffer.items;
+    mpb_counted(mpb);
+    return 0;
+}
+
+static void _mpb_init(Mpb *mpb) {
+    mpb->buffer.count = 0;
+    mpb->buffer.failed = false;
+    mpb->level = 0;
+    mpb->state[0] = MPB_STATE_START;
+    mpb->is_first = true;
+}
+
+static int mpb_begin(Mpb *mpb, MpbState state) {
+    if (mpb->level == 0) _mpb_init(mpb);
+    if (mpb->level + 1 >= MPB_MAX_NESTING) return -1;
+    // Placeholder header: map32/array32 marker and count
+    unsigned char *out = mpb_reserve(mpb, 5);
+    if (!out) return -1;
+    mpb_counted(mpb);
+    mpb->level++;
+    mpb->state[mpb->level] = state;
+    mpb->header[mpb->level] = mpb->buffer.count;
+    mpb->count[mpb->level] = 0;
+    mpb->buffer.count += 5;
+    mpb->is_first = true;
+    return 0;
+}
+
+static int mpb_end(Mpb *mpb, MpbState state) {
+    if (mpb->level < 1 || mpb->state[mpb->level] != state || mpb->is_key) return -1;
+    if (mpb->buffer.failed) return -1;
+    size_t header = mpb->header[mpb->level];
+    uint32_t count = mpb->count[mpb->level];
+    unsigned char *out = mpb->buffer.items + header;
+    size_t size;
+    if (count < 16) {
+        out[0] = (unsigned char)((state == MPB_STATE_OBJECT ? 0x80 : 0x90) | count);
+        size = 1;
+    } else if (count <= 0xFFFF) {
+        out[0] = state == MPB_STATE_OBJECT ? 0xde : 0xdc;
+        mpb_put_be(out + 1, count, 2);
+        size = 3;
+    } else {
+        out[0] = state == MPB_STATE_OBJECT ? 0xdf : 0xdd;
+        mpb_put_be(out + 1, count, 4);
+        size = 5;
+    }
+    if (size < 5) {
+        size_t body = mpb->buffer.count - header - 5;
+        memmove(out + size, out + 5, body);
+        mpb->buffer.count -= 5 - size;
+    }
+    mpb->level--;
+    if (mpb->level == 0) mpb->state[0] = MPB_STATE_END;
+    return 0;
+}
+
+int mpb_begin_object(Mpb *mpb) {
+    return mpb_begin(mpb, MPB_STATE_OBJECT);
+}
+
+int mpb_end_object(Mpb *mpb) {
+    return mpb_end(mpb, MPB_STATE_OBJECT);
+}
+
+int mpb_begin_array(Mpb *mpb) {
+    return mpb_begin(mpb, MPB_STATE_ARRAY);
+}
+
+int mpb_end_array(Mpb *mpb) {
+    return mpb_end(mpb, MPB_STATE_ARRAY);
+}
+
+static unsigned char *mpb_put_str_header(unsigned char *out, size_t len) {
+    if (len < 32) {
+        *out++ = (unsigned char)(0xa0 | len);
+    } else if (len <= 0xFF) {
+        *out++ = 0xd9;
+        *out++ = (unsigned char)len;
+    } else if (len <= 0xFFFF) {
+        *out++ = 0xda;
+        out = mpb_put_be(out, len, 2);
+    } else {
+        *out++ = 0xdb;
+        out = mpb_put_be(out, len, 4);
+    }
+    return out;
+}
+
+int mpb_key(Mpb *mpb, const char *key) {
+    if (mpb->state[mpb->level] != MPB_STATE_OBJECT || mpb->is_key || mpb->buffer.failed) return -1;
+    size_t len = strlen(key);
+    if (len > 0xFFFFFFFF) return -1;
+    if (mpb_srealloc(&mpb->buffer, mpb->buffer.count + len + 5)) return -1;
+    unsigned char *out = mpb_put_str_header(mpb->buffer.items + mpb->buffer.count, len);
+    memcpy(out, key, len);
+    mpb->buffer.count = out + len - mpb->buffer.items;
+    mpb->count[mpb->level]++;
+    mpb->is_key = true;
+    return 0;
+}
+
+int mpb_nstring(Mpb *mpb, const char *str, size_t len) {
+    if (!str) return mpb_null(mpb);
+    if (len > 0xFFFFFFFF) return -1;
+    unsigned char *out = mpb_reserve(mpb, len + 5);
+    if (!out) return -1;
+    out = mpb_put_str_header(out, len);
+    memcpy(out, str, len);
+    return mpb_commit(mpb, out + len);
+}
+
+int mpb_bin(Mpb *mpb, const void *data, size_t len) {
+    if (len > 0xFFFFFFFF) return -1;
+    unsigned char *out = mpb_reserve(mpb, len + 5);
+    if (!out) return -1;
+    if (len <= 0xFF) {
+        *out++ = 0xc4;
+        *out++ = (unsigned char)len;
+    } else if (len <= 0xFFFF) {
+        *out++ = 0xc5;
+        out = mpb_put_be(out, len, 2);
+    } else {
+        *out++ = 0xc6;
+        out = mpb_put_be(out, len, 4);
+    }
+    if (len) memcpy(out, data, len);
+    return mpb_commit(mpb, out + len);
+}
+
+int mpb_int(Mpb *mpb, int value) {
+    return mpb_int64(mpb, value);
+}
+
+int mpb_int64(Mpb *mpb, int64_t value) {
+    if (value >= 0) return mpb_uint64(mpb, (uint64_t)value);
+    unsigned char *out = mpb_reserve(mpb, 9);
+    if (!out) return -1;
+    if (value >= -32) {
+        *out++ = (unsigned char)(int8_t)value;
+    } else if (value >= INT8_MIN) {
+        *out++ = 0xd0;
+        *out++ = (unsigned char)(int8_t)value;
+    } else if (value >= INT16_MIN) {
+        *out++ = 0xd1;
+        out = mpb_put_be(out, (uint64_t)value, 2);
+    } else if (value >= INT32_MIN) {
+        *out++ = 0xd2;
+        out = mpb_put_be(out, (uint64_t)value, 4);
+    } else {
+        *out++ = 0xd3;
+        out = mpb_put_be(out, (uint64_t)value, 8);
+    }
+    return mpb_commit(mpb, out);
+}
+
+int mpb_uint64(Mpb *mpb, uint64_t value) {
+    unsigned char *out = mpb_reserve(mpb, 9);
+    if (!out) return -1;
+    if (value < 128) {
+        *out++ = (unsigned char)value;
+    } else if (value <= 0xFF) {
+        *out++ = 0xcc;
+        *out++ = (unsigned char)value;
+    } else if (value <= 0xFFFF) {
+        *out++ = 0xcd;
+        out = mpb_put_be(out, value, 2);
+    } else if (value <= 0xFFFFFFFF) {
+        *out++ = 0xce;
+        out = mpb_put_be(out, value, 4);
+    } else {
+        *out++ = 0xcf;
+        out = mpb_put_be(out, value, 8);
+    }
+    return mpb_commit(mpb, out);
+}
+
+int mpb_double(Mpb *mpb, double value) {
+    unsigned char *out = mpb_reserve(mpb, 9);
+    if (!out) return -1;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    *out++ = 0xcb;
+    return mpb_commit(mpb, mpb_put_be(out, bits, 8));
+}
+
+int mpb_float(Mpb *mpb, float value) {
+    unsigned char *out = mpb_reserve(mpb, 5);
+    if (!out) return -1;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    *out++ = 0xca;
+    return mpb_commit(mpb, mpb_put_be(out, bits, 4));
+}
+
+int mpb_bool(Mpb *mpb, bool value) {
+    unsigned char *out = mpb_reserve(mpb, 1);
+    if (!out) return -1;
+    *out++ = value ? 0xc3 : 0xc2;
+    return mpb_commit(mpb, out);
+}
+
+int mpb_timestamp(Mpb *mpb, int64_t timestamp, uint32_t nsec) {
+    if (nsec >= 1000000000) return -1;
+    unsigned char *out = mpb_reserve(mpb, 15);
+    if (!out) return -1;
+    if (timestamp >= 0 && timestamp >> 34 == 0) {
+        if (nsec == 0 && timestamp <= 0xFFFFFFFF) {
+            // timestamp 32
+            *out++ = 0xd6;
+            *out++ = 0xff;
+            out = mpb_put_be(out, (uint64_t)timestamp, 4);
+        } else {
+            // timestamp 64
+            *out++ = 0xd7;
+            *out++ = 0xff;
+            out = mpb_put_be(out, ((uint64_t)nsec << 34) | (uint64_t)timestamp, 8);
+        }
+    } else {
+        // timestamp 96
+        *out++ = 0xc7;
+        *out++ = 12;
+        *out++ = 0xff;
+        out = mpb_put_be(out, nsec, 4);
+        out = mpb_put_be(out, (uint64_t)timestamp, 8);
+    }
+    return mpb_commit(mpb, out);
+}
+
+int mpb_null(Mpb *mpb) {
+    unsigned char *out = mpb_reserve(mpb, 1);
+    if (!out) return -1;
+    *out++ = 0xc0;
+    return mpb_commit(mpb, out);
+}
+
+#endif // MPB_IMPLEMENTATION
+#endif // MPB_H_
@@ -0,0 +1,428 @@
+/**
+ * Simple MessagePack pull parser, with the same API shape as jsp.h
+ * https://github.com/mceck/c-stb
+ *
+ * Example:
+```c
+#define MPP_IMPLEMENTATION
+#include "mpp.h"
+...
+    Mpp mpp = {0};
+    mpp_init(&mpp, data, size);
+    mpp_begin_object(&mpp);
+    while (mpp_key(&mpp) == 0) {
+        if (mpp_key_eq(&mpp, "name")) {
+            mpp_value(&mpp);
+            printf("Name: %.*s\n", (int)mpp.string_len, mpp.string);
+        } else if (mpp_key_eq(&mpp, "age")) {
+            mpp_value(&mpp);
+            printf("Age: %lld\n", (long long)mpp.integer);
+        } else if (mpp_key_eq(&mpp, "array")) {
+            mpp_begin_array(&mpp);
+            while (mpp_value(&mpp) == 0) {
+                if (mpp.type == JSP_TYPE_NUMBER) printf("Array item (number): %.2f\n", mpp.number);
+            }
+            mpp_end_array(&mpp);
+        } else {
+            mpp_skip(&mpp); // skip other values
+        }
+    }
+    mpp_end_object(&mpp);
+```
+ *
+ * Values are reported with the JspType values of jsp.h.
+ * Strings, keys and binary data are views into the input, they are not NUL terminated.
+ * Nothing is allocated.
+ */
+
+#ifndef MPP_H_
+#define MPP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "jsp.h"
+
+#ifndef MPP_MAX_NESTING
+#define MPP_MAX_NESTING 64
+#endif
+
+typedef enum {
+    MPP_OK,
+    MPP_OBJECT,
+    MPP_ARRAY,
+    MPP_KEY
+} MppState;
+
+typedef struct {
+    const unsigned char *buffer;
+    size_t off;
+    size_t length;
+    MppState state[MPP_MAX_NESTING];
+    uint32_t remaining[MPP_MAX_NESTING]; // keys (maps) or elements (arrays) left
+    int level;
+    JspType type;
+    bool is_bin;         // the string is bin data
+    const char *string;  // string/key/bin view
+    size_t string_len;
+    int64_t integer;     // integer values (saturated), and the seconds of timestamps
+    uint64_t uinteger;   // non-negative integer values, exact above INT64_MAX
+    uint32_t nsec;       // nanoseconds of timestamps
+    int8_t ext_type;     // extension type of JSP_TYPE_UNKNOWN values, data in string
+    union {
+        double number;
+        bool boolean;
+    };
+} Mpp;
+
+/**
+ * Initialize the MPP parser with a buffer and its length.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_init(Mpp *mpp, const void *buffer, size_t length);
+/**
+ * Try parse a map start.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_begin_object(Mpp *mpp);
+/**
+ * Try parse a map end, all its entries must have been read.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_end_object(Mpp *mpp);
+/**
+ * Try parse an array start.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_begin_array(Mpp *mpp);
+/**
+ * Try parse an array end, all its elements must have been read.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_end_array(Mpp *mpp);
+/**
+ * Get the number of elements left in the current array, from its header.
+ * Returns the number of elements, or -1 on failure.
+ */
+int mpp_array_length(Mpp *mpp);
+/**
+ * Try parse a string key in a map.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_key(Mpp *mpp);
+#define mpp_key_eq(mpp, str) ((mpp)->string_len == strlen(str) && memcmp((mpp)->string, (str), (mpp)->string_len) == 0)
+/**
+ * Try parse a value (string, bin, number, boolean, nil, extension) in a map or array.
+ * On maps and arrays type is set and -1 is returned, like jsp_value.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_value(Mpp *mpp);
+/**
+ * Skip the next value, containers included, using the length prefixes.
+ * Returns 0 on success, -1 on failure.
+ */
+int mpp_skip(Mpp *mpp);
+
+#ifdef MPP_IMPLEMENTATION
+
+static uint64_t mpp_be(const unsigned char *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+typedef struct {
+    JspType type;
+    size_t header; // header bytes, including fixed-size scalar payloads
+    size_t len;    // str/bin/ext payload bytes
+    uint64_t count; // elements of arrays, entries of maps
+} MppItem;
+
+/**
+ * Reads the header of the item at the current offset without consuming it.
+ * Returns 0 on success, -1 on failure.
+ */
+static int mpp_peek(Mpp *mpp, MppItem *it) {
+    if (mpp->off >= mpp->length) return -1;
+    const unsigned char *p = mpp->buffer + mpp->off;
+    size_t avail = mpp->length - mpp->off;
+    unsigned char c = p[0];
+    *it = (MppItem){JSP_TYPE_UNKNOWN, 1, 0, 0};
+    int size = 0; // bytes of the length/count field
+    if (c <= 0x7f || c >= 0xe0) {
+        it->type = JSP_TYPE_NUMBER;
+        return 0;
+    } else if (c <= 0x8f) {
+        it->type = JSP_TYPE_OBJECT;
+        it->count = c & 0x0f;
+        return 0;
+    } else if (c <= 0x9f) {
+        it->type = JSP_TYPE_ARRAY;
+        it->count = c & 0x0f;
+        return 0;
+    } else if (c <= 0xbf) {
+        it->type = JSP_TYPE_STRING;
+        it->len = c & 0x1f;
+    } else {
+        switch (c) {
+        case 0xc0:
+            it->type = JSP_TYPE_NULL;
+            return 0;
+        case 0xc2:
+        case 0xc3:
+            it->type = JSP_TYPE_BOOLEAN;
+            return 0;
+        case 0xc4: case 0xc5: case 0xc6:
+            it->type = JSP_TYPE_STRING;
+            size = 1 << (c - 0xc4);
+            break;
+        case 0xc7: case 0xc8: case 0xc9:
+            // ext 8/16/32: length then type byte
+            size = 1 << (c - 0xc7);
+            it->header++;
+            break;
+        case 0xca: case 0xcb:
+            it->type = JSP_TYPE_NUMBER;
+            it->header += c == 0xca ? 4 : 8;
+            break;
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            it->type = JSP_TYPE_NUMBER;
+            it->header += 1 << (c - 0xcc);
+            break;
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+            it->type = JSP_TYPE_NUMBER;
+            it->header += 1 << (c - 0xd0);
+            break;
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+            // fixext: type byte then 1-16 bytes
+            it->header++;
+            it->len = 1 << (c - 0xd4);
+            break;
+        case 0xd9: case 0xda: case 0xdb:
+            it->type = JSP_TYPE_STRING;
+            size = 1 << (c - 0xd9);
+            break;
+        case 0xdc: case 0xdd:
+            it->type = JSP_TYPE_ARRAY;
+            size = c == 0xdc ? 2 : 4;
+            break;
+        case 0xde: case 0xdf:
+            it->type = JSP_TYPE_OBJECT;
+            size = c == 0xde ? 2 : 4;
+            break;
+        default:
+            return -1; // 0xc1 is never used
+        }
+    }
+    if (avail < it->header + size) return -1;
+    if (size) {
+        uint64_t n = mpp_be(p + 1, size);
+        if (it->type == JSP_TYPE_ARRAY || it->type == JSP_TYPE_OBJECT) it->count = n;
+        else it->len = n;
+        it->header += size;
+    }
+    if (avail - it->header < it->len) return -1;
+    if (it->type == JSP_TYPE_UNKNOWN && it->len == 12 && (int8_t)p[it->header - 1] == -1) it->type = JSP_TYPE_NUMBER;
+    if (it->type == JSP_TYPE_UNKNOWN && (c == 0xd6 || c == 0xd7) && (int8_t)p[1] == -1) it->type = JSP_TYPE_NUMBER;
+    return 0;
+}
+
+static void mpp_zero_ret(Mpp *mpp) {
+    mpp->string = NULL;
+    mpp->string_len = 0;
+    mpp->is_bin = false;
+    mpp->integer = 0;
+    mpp->uinteger = 0;
+    mpp->nsec = 0;
+    mpp->ext_type = 0;
+    mpp->number = 0;
+}
+
+/**
+ * A value is expected after a key or inside an array with elements left.
+ */
+static int mpp_check_val(Mpp *mpp) {
+    MppState state = mpp->state[mpp->level];
+    if (state == MPP_KEY) return 0;
+    if (state == MPP_ARRAY && mpp->remaining[mpp->level] > 0) return 0;
+    return -1;
+}
+
+// Marks the current value as read
+static void mpp_value_done(Mpp *mpp) {
+    if (mpp->state[mpp->level] == MPP_KEY) mpp->level--;
+    else if (mpp->state[mpp->level] == MPP_ARRAY) mpp->remaining[mpp->level]--;
+}
+
+int mpp_init(Mpp *mpp, const void *buffer, size_t length) {
+    if (!mpp || !buffer || length == 0) return -1;
+    mpp->buffer = buffer;
+    mpp->length = length;
+    mpp->off = 0;
+    mpp->level = 0;
+    mpp->state[0] = MPP_OK;
+    return 0;
+}
+
+static int mpp_begin(Mpp *mpp, JspType type, MppState state) {
+    MppState parent = mpp->state[mpp->level];
+    if (parent == MPP_OBJECT) return -1;
+    if (parent != MPP_OK && mpp_check_val(mpp)) return -1;
+    if (mpp->level + 1 >= MPP_MAX_NESTING) return -1;
+    MppItem it;
+    if (mpp_peek(mpp, &it) || it.type != type || it.count > UINT32_MAX) return -1;
+    if (parent == MPP_ARRAY) mpp->remaining[mpp->level]--;
+    mpp->off += it.header;
+    mpp->state[++mpp->level] = state;
+    mpp->remaining[mpp->level] = (uint32_t)it.count;
+    return 0;
+}
+
+static int mpp_end(Mpp *mpp, MppState state) {
+    if (mpp->state[mpp->level] != state || mpp->level <= 0) return -1;
+    if (mpp->remaining[mpp->level] != 0) return -1;
+    mpp->level--;
+    if (mpp->state[mpp->level] == MPP_KEY) {
+        if (mpp->level <= 0) return -1;
+        mpp->level--;
+    }
+    if (mpp->level == 0) mpp->state[0] = MPP_OK;
+    return 0;
+}
+
+int mpp_begin_object(Mpp *mpp) {
+    return mpp_begin(mpp, JSP_TYPE_OBJECT, MPP_OBJECT);
+}
+
+int mpp_end_object(Mpp *mpp) {
+    return mpp_end(mpp, MPP_OBJECT);
+}
+
+int mpp_begin_array(Mpp *mpp) {
+    return mpp_begin(mpp, JSP_TYPE_ARRAY, MPP_ARRAY);
+}
+
+int mpp_end_array(Mpp *mpp) {
+    return mpp_end(mpp, MPP_ARRAY);
+}
+
+int mpp_array_length(Mpp *mpp) {
+    if (mpp->state[mpp->level] != MPP_ARRAY) return -1;
+    if (mpp->remaining[mpp->level] > INT32_MAX) return -1;
+    return (int)mpp->remaining[mpp->level];
+}
+
+int mpp_key(Mpp *mpp) {
+    if (mpp->state[mpp->level] != MPP_OBJECT || mpp->remaining[mpp->level] == 0) return -1;
+    if (mpp->level + 1 >= MPP_MAX_NESTING) return -1;
+    MppItem it;
+    if (mpp_peek(mpp, &it) || it.type != JSP_TYPE_STRING) return -1;
+    mpp_zero_ret(mpp);
+    mpp->string = (const char *)mpp->buffer + mpp->off + it.header;
+    mpp->string_len = it.len;
+    mpp->off += it.header + it.len;
+    mpp->remaining[mpp->level]--;
+    mpp->state[++mpp->level] = MPP_KEY;
+    return 0;
+}
+
+int mpp_value(Mpp *mpp) {
+    if (mpp_check_val(mpp)) return -1;
+    MppItem it;
+    if (mpp_peek(mpp, &it)) return -1;
+    mpp->type = it.type;
+    if (it.type == JSP_TYPE_OBJECT || it.type == JSP_TYPE_ARRAY) return -1;
+    mpp_zero_ret(mpp);
+    const unsigned char *p = mpp->buffer + mpp->off;
+    unsigned char c = p[0];
+    switch (it.type) {
+    case JSP_TYPE_STRING:
+        mpp->is_bin = c >= 0xc4 && c <= 0xc6;
+        mpp->string = (const char *)p + it.header;
+        mpp->string_len = it.len;
+        break;
+    case JSP_TYPE_BOOLEAN:
+        mpp->boolean = c == 0xc3;
+        break;
+    case JSP_TYPE_NUMBER:
+        if (c <= 0x7f) {
+            mpp->integer = c;
+        } else if (c >= 0xe0) {
+            mpp->integer = (int8_t)c;
+        } else if (c == 0xca) {
+            uint32_t bits = (uint32_t)mpp_be(p + 1, 4);
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            mpp->number = f;
+            break;
+        } else if (c == 0xcb) {
+            uint64_t bits = mpp_be(p + 1, 8);
+            memcpy(&mpp->number, &bits, sizeof(mpp->number));
+            break;
+        } else if (c >= 0xcc && c <= 0xcf) {
+            mpp->uinteger = mpp_be(p + 1, it.header - 1);
+            mpp->integer = mpp->uinteger > INT64_MAX ? INT64_MAX : (int64_t)mpp->uinteger;
+            mpp->number = (double)mpp->uinteger;
+            break;
+        } else if (c >= 0xd0 && c <= 0xd3) {
+            int bytes = (int)it.header - 1;
+            uint64_t v = mpp_be(p + 1, bytes);
+            // Sign extend
+            if (bytes < 8 && (v >> (bytes * 8 - 1))) v |= ~0ULL << (bytes * 8);
+            mpp->integer = (int64_t)v;
+        } else {
+            // Timestamp extension
+            const unsigned char *data = p + it.header;
+            if (it.len == 4) {
+                mpp->integer = (int64_t)mpp_be(data, 4);
+            } else if (it.len == 8) {
+                uint64_t v = mpp_be(data, 8);
+                mpp->nsec = (uint32_t)(v >> 34);
+                mpp->integer = (int64_t)(v & ((1ULL << 34) - 1));
+            } else {
+                mpp->nsec = (uint32_t)mpp_be(data, 4);
+                mpp->integer = (int64_t)mpp_be(data + 4, 8);
+            }
+            mpp->number = (double)mpp->integer + mpp->nsec / 1e9;
+            break;
+        }
+        mpp->number = (double)mpp->integer;
+        if (mpp->integer >= 0) mpp->uinteger = (uint64_t)mpp->integer;
+        break;
+    case JSP_TYPE_UNKNOWN:
+        mpp->ext_type = (int8_t)p[it.header - 1];
+        mpp->string = (const char *)p + it.header;
+        mpp->string_len = it.len;
+        break;
+    default:
+        break;
+    }
+    mpp->off += it.header + it.len;
+    mpp_value_done(mpp);
+    return 0;
+}
+
+int mpp_skip(Mpp *mpp) {
+    if (mpp_check_val(mpp)) return -1;
+    // Items left to skip, containers add their children
+    uint64_t pending = 1;
+    size_t off = mpp->off;
+    while (pending) {
+        MppItem it;
+        if (mpp_peek(mpp, &it)) {
+            mpp->off = off;
+            return -1;
+        }
+        pending--;
+        if (it.type == JSP_TYPE_ARRAY) pending += it.count;
+        else if (it.type == JSP_TYPE_OBJECT) pending += it.count * 2;
+        mpp->off += it.header + it.len;
+    }
+    mpp_value_done(mpp);
+    return 0;
+}
+
+#endif // MPP_IMPLEMENTATION
+#endif // MPP_H_
@@ -1,4 +1,4 @@
 #!/bin/bash
 set -e
-gcc -o tests/test tests/tests.c -lcurl
+gcc -o tests/test tests/tests.c -lcurl -lz -pthread
 tests/test
\ No newline at end of file
@@ -0,0 +1,65 @@
+#define _POSIX_C_SOURCE 199309L
+#define JSB_IMPLEMENTATION
+#include "../jsb.h"
+
+#define RECORDS 2000
+#define ROUNDS 50
+#define REPEAT 7
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int build(Jsb *jsb) {
+    int r = jsb_begin_array(jsb);
+    for (int i = 0; i < RECORDS && !r; ++i) {
+        r = r || jsb_begin_object(jsb);
+        r = r || jsb_key_tok(jsb, JSB_KEY("id"));
+        r = r || jsb_int(jsb, i);
+        r = r || jsb_key_tok(jsb, JSB_KEY("name"));
+        r = r || jsb_string(jsb, "John Doe");
+        r = r || jsb_key_tok(jsb, JSB_KEY("score"));
+        r = r || jsb_double(jsb, i * 0.25);
+        r = r || jsb_key_tok(jsb, JSB_KEY("active"));
+        r = r || jsb_bool(jsb, i % 2);
+        r = r || jsb_key_tok(jsb, JSB_KEY("tags"));
+        r = r || jsb_begin_array(jsb);
+        r = r || jsb_string(jsb, "a");
+        r = r || jsb_null(jsb);
+        r = r || jsb_int(jsb, -i);
+        r = r || jsb_end_array(jsb);
+        r = r || jsb_end_object(jsb);
+    }
+    return r || jsb_end_array(jsb);
+}
+
+static int bench(const char *name, int pp) {
+    Jsb jsb = {.pp = pp};
+    // Warm up and size the buffer
+    if (build(&jsb)) return 1;
+    size_t bytes = jsb.buffer.count;
+    // Best of REPEAT runs, to filter out noise from other processes
+    double elapsed = 0;
+    for (int k = 0; k < REPEAT; ++k) {
+        double start = now();
+        for (int i = 0; i < ROUNDS; ++i) {
+            jsb_reset(&jsb);
+            if (build(&jsb)) return 1;
+        }
+        double t = now() - start;
+        if (k == 0 || t < elapsed) elapsed = t;
+    }
+    printf("%-8s %8zu bytes  %8.1f ns/record  %8.1f MB/s\n", name, bytes,
+           elapsed * 1e9 / ((double)RECORDS * ROUNDS), bytes * (double)ROUNDS / elapsed / 1e6);
+    jsb_free(&jsb);
+    return 0;
+}
+
+int main(void) {
+    int r = bench("compact", 0);
+    r = r || bench("pp=2", 2);
+    r = r || bench("pp=8", 8);
+    return r;
+}
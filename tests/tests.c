@@ -2,9 +2,14 @@
 #include "../ds.h"
 #include "../http.h"
 #define JSB_IMPLEMENTATION
+#define JSB_ZLIB
 #include "../jsb.h"
 #define JSP_IMPLEMENTATION
 #include "../jsp.h"
+#define MPB_IMPLEMENTATION
+#include "../mpb.h"
+#define MPP_IMPLEMENTATION
+#include "../mpp.h"
 
 HttpHeaders headers = {0};
 
@@ -220,6 +225,222 @@ int test_delete() {
     return 0;
 }
 
+int test_http_client() {
+    log_info("Testing HTTP client connection reuse...\n");
+    HttpClient client = {0};
+    HttpResponse response = {0};
+    int r = 0;
+    for (int i = 0; i < 2 && !r; ++i) {
+        http_reset_response(&response);
+        CURLcode res = http_client(&client, "https://jsonplaceholder.typicode.com/posts/1", &response);
+        if (res != CURLE_OK) {
+            log(ERROR, "HTTP request failed: %s\n", curl_easy_strerror(res));
+            r = 1;
+            break;
+        }
+        long connects = 0;
+        curl_easy_getinfo(client.curl, CURLINFO_NUM_CONNECTS, &connects);
+        log_info("HTTP status: %ld, new connections: %ld\n", response.status_code, connects);
+        // The second request goes over the kept-alive connection
+        if (i == 1 && connects != 0) r = 1;
+    }
+    http_free_response(&response);
+    http_client_free(&client);
+    if (r) {
+        log(ERROR, "HTTP client test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_http_batch() {
+    log_info("Testing HTTP batch requests...\n");
+    HttpClient client = {.max_concurrent = 4};
+    char urls[8][64];
+    HttpRequest requests[8];
+    HttpResponse responses[8] = {0};
+    for (int i = 0; i < 8; ++i) {
+        snprintf(urls[i], sizeof(urls[i]), "https://jsonplaceholder.typicode.com/posts/%d", i + 1);
+        requests[i] = (HttpRequest){.url = urls[i]};
+    }
+    CURLcode res = http_batch(&client, requests, 8, responses);
+    int r = 0;
+    if (res != CURLE_OK) {
+        log(ERROR, "HTTP batch failed: %s\n", curl_easy_strerror(res));
+        r = 1;
+    }
+    // Responses map back to their requests whatever the completion order
+    for (int i = 0; i < 8 && !r; ++i) {
+        Jsp jsp = {0};
+        double id = 0;
+        r = responses[i].status_code != 200 || jsp_init(&jsp, responses[i].body.items, responses[i].body.count);
+        r = r || jsp_begin_object(&jsp);
+        while (!r && jsp_key(&jsp) == 0) {
+            bool is_id = strcmp(jsp.string, "id") == 0;
+            r = jsp_value(&jsp);
+            if (is_id) id = jsp.number;
+        }
+        if (!r && id != i + 1) r = 1;
+        jsp_free(&jsp);
+    }
+    for (int i = 0; i < 8; ++i) {
+        http_free_response(&responses[i]);
+    }
+    http_client_free(&client);
+    if (r) {
+        log(ERROR, "HTTP batch test failed\n");
+        return 1;
+    }
+    log_info("HTTP batch: 8 responses in request order\n");
+    return 0;
+}
+
+static int test_http_line(void *ctx, const char *line, size_t len) {
+    int *next = ctx;
+    Jsp jsp = {0};
+    int r = jsp_init(&jsp, line, len);
+    r = r || jsp_begin_object(&jsp) || jsp_key(&jsp) || jsp_value(&jsp);
+    if (!r && jsp.number != *next) r = 1;
+    r = r || jsp_end_object(&jsp);
+    jsp_free(&jsp);
+    (*next)++;
+    return r ? -1 : 0;
+}
+
+static int test_http_count_chunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(size_t *)ctx += len;
+    return 0;
+}
+
+int test_http_stream() {
+    log_info("Testing HTTP streamed body and NDJSON splitter...\n");
+    int r = 0;
+    // Records split across chunks, CRLF and empty lines, no final new line
+    const char *chunks[] = {"{\"id\":0}\n{\"id\"", ":1}\r\n\n{\"id\":2}\n{\"i", "d\":3", "}"};
+    int next = 0;
+    HttpLines lines = {.on_line = test_http_line, .ctx = &next};
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i) {
+        r = r || http_lines_write(&lines, chunks[i], strlen(chunks[i]));
+    }
+    r = http_lines_finish(&lines) || r;
+    if (!r && next != 4) r = 1;
+
+    size_t received = 0;
+    HttpResponse response = {.on_chunk = test_http_count_chunk, .chunk_ctx = &received};
+    CURLcode res = http("https://jsonplaceholder.typicode.com/posts", &response);
+    if (res != CURLE_OK) {
+        log(ERROR, "HTTP request failed: %s\n", curl_easy_strerror(res));
+        r = 1;
+    }
+    // Nothing was buffered
+    if (!r && (received == 0 || response.body.items)) r = 1;
+    log_info("HTTP status: %ld, streamed %zu bytes\n", response.status_code, received);
+    http_free_response(&response);
+    if (r) {
+        log(ERROR, "HTTP stream test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_http_prealloc() {
+    log_info("Testing HTTP body preallocation...\n");
+    int r = 0;
+    HttpResponse response = {.size_hint = 1 << 16};
+    CURLcode res = http("https://jsonplaceholder.typicode.com/posts/1", &response);
+    if (res != CURLE_OK) {
+        log(ERROR, "HTTP request failed: %s\n", curl_easy_strerror(res));
+        r = 1;
+    }
+    // The hinted buffer was large enough: no reallocation, terminated once at the end
+    if (!r && (response.body.capacity != 1 << 16 || strlen(response.body.items) != response.body.count)) r = 1;
+    log_info("HTTP status: %ld, %zu bytes in a %zu bytes buffer\n", response.status_code, response.body.count, response.body.capacity);
+    http_free_response(&response);
+    if (r) {
+        log(ERROR, "HTTP preallocation test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void *test_http_share_worker(void *arg) {
+    HttpResponse response = {0};
+    CURLcode res = http("https://jsonplaceholder.typicode.com/posts/1", &response);
+    *(int *)arg = res != CURLE_OK || response.status_code != 200;
+    http_free_response(&response);
+    // The thread default client is freed when the thread exits
+    return NULL;
+}
+
+int test_http_share() {
+    log_info("Testing HTTP share across threads...\n");
+    HttpShare share;
+    if (http_share_init(&share, false) != CURLE_OK) {
+        log(ERROR, "HTTP share init failed\n");
+        return 1;
+    }
+    http_share_default(&share);
+    // The thread default clients all use the share: DNS and TLS sessions are resolved and negotiated once
+    int r = 0, errors[4] = {0};
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, test_http_share_worker, &errors[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+        r = r || errors[i];
+    }
+    // The main thread client lets go of the share on its first request once it is unset
+    HttpResponse response = {0};
+    r = r || http("https://jsonplaceholder.typicode.com/posts/1", &response) != CURLE_OK;
+    http_share_default(NULL);
+    r = r || http("https://jsonplaceholder.typicode.com/posts/1", &response) != CURLE_OK;
+    http_free_response(&response);
+    // Every client using it is gone
+    if (http_share_free(&share) != CURLSHE_OK || share.share) r = 1;
+    if (r) {
+        log(ERROR, "HTTP share test failed\n");
+        return 1;
+    }
+    log_info("HTTP share: 4 threads done\n");
+    return 0;
+}
+
+int test_http2() {
+    log_info("Testing HTTP/2 multiplexed batch...\n");
+    HttpClient client = {.version = HTTP_VERSION_2, .max_host_connections = 1, .max_streams = 8};
+    char urls[8][64];
+    HttpRequest requests[8];
+    HttpResponse responses[8] = {0};
+    for (int i = 0; i < 8; ++i) {
+        snprintf(urls[i], sizeof(urls[i]), "https://jsonplaceholder.typicode.com/posts/%d", i + 1);
+        requests[i] = (HttpRequest){.url = urls[i]};
+    }
+    CURLcode res = http_batch(&client, requests, 8, responses);
+    int r = 0;
+    if (res != CURLE_OK) {
+        log(ERROR, "HTTP batch failed: %s\n", curl_easy_strerror(res));
+        r = 1;
+    }
+    for (int i = 0; i < 8 && !r; ++i) {
+        r = responses[i].status_code != 200;
+    }
+    // Every transfer shared the one connection, multiplexed when the server speaks HTTP/2
+    if (!r && (client.stats.requests != 8 || client.stats.connects != 1)) r = 1;
+    log_info("HTTP/2: %ld requests, %ld connections, %ld over HTTP/2, at most %d in flight\n", client.stats.requests,
+             client.stats.connects, client.stats.http2, client.stats.peak_in_flight);
+    for (int i = 0; i < 8; ++i) {
+        http_free_response(&responses[i]);
+    }
+    http_client_free(&client);
+    if (r) {
+        log(ERROR, "HTTP/2 test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
 #define LOG_TEST r = r ||
 int test_jsb_builder() {
     log_info("Testing JSB builder...\n");
@@ -257,6 +478,894 @@ int test_jsb_builder() {
     return 0;
 }
 
+int test_jsb_escape() {
+    log_info("Testing JSB string escaping...\n");
+    const char *raw = "tab\tquote\"bs\\\r\b\f\x01 caf\xc3\xa9 \xf0\x9f\x98\x80";
+    int r = 0;
+    Jsb jsb = {0};
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_string(&jsb, raw);
+    LOG_TEST jsb_end_array(&jsb);
+    const char *expected = "[\"tab\\tquote\\\"bs\\\\\\r\\b\\f\\u0001 caf\xc3\xa9 \xf0\x9f\x98\x80\"]";
+    if (strcmp(jsb_get(&jsb), expected) != 0) r = 1;
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    // Every escape is decoded back, \/ included
+    Jsp jsp = {0};
+    LOG_TEST jsp_sinit(&jsp, jsb_get(&jsb));
+    LOG_TEST jsp_begin_array(&jsp);
+    LOG_TEST jsp_value(&jsp);
+    if (!r && strcmp(jsp.string, raw) != 0) r = 1;
+    LOG_TEST jsp_sinit(&jsp, "[\"a\\/b\"]");
+    LOG_TEST jsp_begin_array(&jsp);
+    LOG_TEST jsp_value(&jsp);
+    if (!r && strcmp(jsp.string, "a/b") != 0) r = 1;
+    jsp_free(&jsp);
+
+    jsb.ascii = true;
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_string(&jsb, raw);
+    LOG_TEST jsb_end_array(&jsb);
+    expected = "[\"tab\\tquote\\\"bs\\\\\\r\\b\\f\\u0001 caf\\u00e9 \\ud83d\\ude00\"]";
+    if (strcmp(jsb_get(&jsb), expected) != 0) r = 1;
+    log_info("JSB (ascii): %s\n", jsb_get(&jsb));
+    jsb_free(&jsb);
+
+    if (r) {
+        log(ERROR, "JSB escape test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_integers() {
+    log_info("Testing JSB integers...\n");
+    int r = 0;
+    Jsb jsb = {0};
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_int(&jsb, -2147483647 - 1);
+    LOG_TEST jsb_int64(&jsb, INT64_MIN);
+    LOG_TEST jsb_int64(&jsb, 0);
+    LOG_TEST jsb_uint64(&jsb, UINT64_MAX);
+    LOG_TEST jsb_end_array(&jsb);
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    if (strcmp(jsb_get(&jsb), "[-2147483648,-9223372036854775808,0,18446744073709551615]") != 0) r = 1;
+    jsb_free(&jsb);
+
+    if (r) {
+        log(ERROR, "JSB integers test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_doubles() {
+    log_info("Testing JSB doubles...\n");
+    int r = 0;
+    Jsb jsb = {0};
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_double(&jsb, 0.1);
+    LOG_TEST jsb_double(&jsb, -2.5);
+    LOG_TEST jsb_double(&jsb, 1e-9);
+    LOG_TEST jsb_double(&jsb, 1e20);
+    LOG_TEST jsb_double(&jsb, 1234567.0);
+    LOG_TEST jsb_double(&jsb, 0.0 / 0.0);
+    LOG_TEST jsb_float(&jsb, 0.1f);
+    LOG_TEST jsb_end_array(&jsb);
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    if (strcmp(jsb_get(&jsb), "[0.1,-2.5,1e-9,1e20,1234567,null,0.1]") != 0) r = 1;
+    jsb_free(&jsb);
+
+    if (r) {
+        log(ERROR, "JSB doubles test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_keys() {
+    log_info("Testing JSB key tokens...\n");
+    int r = 0;
+    JsbKey quoted = {0};
+    LOG_TEST jsb_key_init(&quoted, "say \"hi\"", false);
+    Jsb jsb = {.pp = 2};
+    LOG_TEST jsb_begin_object(&jsb);
+    {
+        LOG_TEST jsb_key_tok(&jsb, JSB_KEY("id"));
+        LOG_TEST jsb_int(&jsb, 1);
+        LOG_TEST jsb_key_tok(&jsb, quoted);
+        LOG_TEST jsb_bool(&jsb, true);
+    }
+    LOG_TEST jsb_end_object(&jsb);
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    if (strcmp(jsb_get(&jsb), "\n{\n  \"id\": 1,\n  \"say \\\"hi\\\"\": true\n}") != 0) r = 1;
+    jsb_key_free(&quoted);
+    jsb_free(&jsb);
+
+    if (r) {
+        log(ERROR, "JSB key tokens test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_dates() {
+    log_info("Testing JSB dates...\n");
+    int r = 0;
+    Jsb jsb = {0};
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_date(&jsb, 951782400);
+    LOG_TEST jsb_datetime(&jsb, 1700000000);
+    LOG_TEST jsb_datetime_ms(&jsb, 1700000000123LL);
+    LOG_TEST jsb_datetime_us(&jsb, -1);
+    LOG_TEST jsb_end_array(&jsb);
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    const char *expected = "[\"2000-02-29\",\"2023-11-14T22:13:20Z\",\"2023-11-14T22:13:20.123Z\",\"1969-12-31T23:59:59.999999Z\"]";
+    if (strcmp(jsb_get(&jsb), expected) != 0) r = 1;
+    jsb_free(&jsb);
+
+    if (r) {
+        log(ERROR, "JSB dates test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_fixed_buffer() {
+    log_info("Testing JSB fixed buffer...\n");
+    int r = 0;
+    char small[16];
+    Jsb jsb = {0};
+    jsb_init_buffer(&jsb, small, sizeof(small), false);
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_int(&jsb, 1);
+    if (jsb_string(&jsb, "does not fit in 16 bytes") != -1 || !jsb_failed(&jsb)) r = 1;
+    if (jsb_get(&jsb) || jsb.buffer.items != small) r = 1;
+
+    // The ends after an overflow must not unwind the nesting and let the next begin restart the document
+    char tiny[11];
+    jsb_init_buffer(&jsb, tiny, sizeof(tiny), false);
+    int err = jsb_begin_object(&jsb);
+    err |= jsb_key(&jsb, "aaaaa");
+    err |= jsb_begin_object(&jsb);
+    err |= jsb_key(&jsb, "x");
+    err |= jsb_int(&jsb, 1);
+    err |= jsb_end_object(&jsb);
+    err |= jsb_key(&jsb, "b");
+    err |= jsb_begin_object(&jsb);
+    err |= jsb_key(&jsb, "y");
+    err |= jsb_int(&jsb, 2);
+    err |= jsb_end_object(&jsb);
+    if (jsb_end_object(&jsb) != -1 || !err || !jsb_failed(&jsb) || jsb_get(&jsb)) r = 1;
+    if (jsb_begin_object(&jsb) != -1 || !jsb_failed(&jsb) || jsb_get(&jsb)) r = 1;
+    jsb_reset(&jsb);
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_end_array(&jsb);
+    if (!jsb_get(&jsb) || strcmp(jsb_get(&jsb), "[]") != 0) r = 1;
+
+    jsb_init_buffer(&jsb, small, sizeof(small), true);
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_int(&jsb, 1);
+    LOG_TEST jsb_string(&jsb, "moves to the heap");
+    LOG_TEST jsb_end_array(&jsb);
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    if (jsb_get(&jsb) == small || strcmp(jsb_get(&jsb), "[1,\"moves to the heap\"]") != 0) r = 1;
+    jsb_free(&jsb);
+
+    if (r) {
+        log(ERROR, "JSB fixed buffer test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_raw_cache() {
+    log_info("Testing JSB raw fragments and cache...\n");
+    int r = 0;
+    int ids[2] = {1, 2};
+    JsbCache cache = {0};
+    Jsb jsb = {0};
+    for (int pass = 0; pass < 2 && !r; ++pass) {
+        LOG_TEST jsb_begin_array(&jsb);
+        LOG_TEST jsb_raw(&jsb, "{\"a\":[1,2]}", 11);
+        LOG_TEST jsb_raw(&jsb, NULL, 0);
+        for (int i = 0; i < 2; ++i) {
+            int hit = jsb_cache_get(&jsb, &cache, &ids[i], 1);
+            if (hit < 0) r = 1;
+            if (hit != pass) r = 1;
+            if (hit == 0) {
+                size_t start = jsb_cache_begin(&jsb);
+                LOG_TEST jsb_begin_object(&jsb);
+                LOG_TEST jsb_key(&jsb, "id");
+                LOG_TEST jsb_int(&jsb, ids[i]);
+                LOG_TEST jsb_end_object(&jsb);
+                LOG_TEST jsb_cache_put(&jsb, &cache, &ids[i], 1, start);
+            }
+        }
+        LOG_TEST jsb_end_array(&jsb);
+        log_info("JSB: %s\n", jsb_get(&jsb));
+        if (strcmp(jsb_get(&jsb), "[{\"a\":[1,2]},null,{\"id\": 1},{\"id\": 2}]") != 0) r = 1;
+    }
+    // A new version is a miss
+    LOG_TEST jsb_begin_array(&jsb);
+    if (jsb_cache_get(&jsb, &cache, &ids[0], 2) != 0) r = 1;
+    jsb_free(&jsb);
+    // A value partly flushed to a sink is skipped without an error
+    char big[5000];
+    memset(big, 'x', sizeof(big));
+    jsb_init_count(&jsb);
+    LOG_TEST jsb_begin_array(&jsb);
+    size_t start = jsb_cache_begin(&jsb);
+    LOG_TEST jsb_nstring(&jsb, big, sizeof(big));
+    LOG_TEST jsb_nstring(&jsb, big, sizeof(big));
+    if (jsb.buffer.flushed <= start) r = 1;
+    LOG_TEST jsb_cache_put(&jsb, &cache, big, 1, start);
+    if (jsb_cache_get(&jsb, &cache, big, 1) != 0) r = 1;
+    jsb_free(&jsb);
+    jsb_cache_free(&cache);
+
+    if (r) {
+        log(ERROR, "JSB raw/cache test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_jsb_collect(void *ctx, const char *data, size_t len) {
+    StringBuilder *sb = ctx;
+    da_append_many(sb, data, len);
+    return 0;
+}
+
+static int test_jsb_parallel_item(Jsb *jsb, size_t i, void *ctx) {
+    const int *values = ctx;
+    if (jsb_begin_object(jsb)) return -1;
+    if (jsb_key(jsb, "v")) return -1;
+    if (jsb_int(jsb, values[i])) return -1;
+    return jsb_end_object(jsb);
+}
+
+int test_jsb_parallel() {
+    log_info("Testing JSB parallel array...\n");
+    int r = 0;
+    int values[1000];
+    for (int i = 0; i < 1000; ++i)
+        values[i] = i * 7;
+    for (int pp = 0; pp <= 2 && !r; pp += 2) {
+        Jsb seq = {.pp = pp}, par = {.pp = pp};
+        LOG_TEST jsb_begin_array(&seq);
+        for (size_t i = 0; i < 1000; ++i)
+            LOG_TEST test_jsb_parallel_item(&seq, i, values);
+        LOG_TEST jsb_end_array(&seq);
+        LOG_TEST jsb_begin_array(&par);
+        LOG_TEST jsb_parallel_array(&par, 1000, test_jsb_parallel_item, values, 4);
+        LOG_TEST jsb_end_array(&par);
+        if (!r && strcmp(jsb_get(&seq), jsb_get(&par)) != 0) r = 1;
+        if (!r && pp == 0) {
+            // Through a sink the merged chunks are flushed as they are appended
+            StringBuilder out = {0};
+            jsb_free(&par);
+            jsb_init_sink(&par, test_jsb_collect, &out, 256);
+            LOG_TEST jsb_begin_array(&par);
+            LOG_TEST jsb_parallel_array(&par, 1000, test_jsb_parallel_item, values, 4);
+            LOG_TEST jsb_end_array(&par);
+            LOG_TEST jsb_flush(&par);
+            if (!r && (out.count != seq.buffer.count || memcmp(out.items, jsb_get(&seq), out.count) != 0)) r = 1;
+            if (!r && par.buffer.capacity > 1024) r = 1;
+            da_free(&out);
+        }
+        jsb_free(&seq);
+        jsb_free(&par);
+    }
+    if (r) {
+        log(ERROR, "JSB parallel array test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_ndjson() {
+    log_info("Testing JSB ndjson...\n");
+    int r = 0;
+    const char *expected = "{\"id\": 0,\"tags\": [\"a\",\"b\"]}\n"
+                           "{\"id\": 1,\"tags\": [\"a\",\"b\"]}\n"
+                           "{\"id\": 2,\"tags\": [\"a\",\"b\"]}\n";
+    // In memory, with a sink flushing after every record and with a tiny fixed buffer
+    for (int mode = 0; mode < 3 && !r; ++mode) {
+        StringBuilder out = {0};
+        char small[16];
+        Jsb jsb = {.pp = 2, .ndjson = true};
+        if (mode == 2) jsb_init_buffer(&jsb, small, sizeof(small), false);
+        if (mode > 0) jsb_init_sink(&jsb, test_jsb_collect, &out, mode == 1 ? 1 : 0);
+        for (int i = 0; i < 3; ++i) {
+            LOG_TEST jsb_begin_object(&jsb);
+            LOG_TEST jsb_key(&jsb, "id");
+            LOG_TEST jsb_int(&jsb, i);
+            LOG_TEST jsb_key(&jsb, "tags");
+            LOG_TEST jsb_begin_array(&jsb);
+            LOG_TEST jsb_string(&jsb, "a");
+            LOG_TEST jsb_string(&jsb, "b");
+            LOG_TEST jsb_end_array(&jsb);
+            LOG_TEST jsb_end_object(&jsb);
+        }
+        LOG_TEST jsb_flush(&jsb);
+        const char *got = mode > 0 ? out.items : jsb_get(&jsb);
+        if (mode == 0) log_info("JSB:\n%s", got);
+        if (!r && (!got || strncmp(got, expected, strlen(expected)) != 0 || (mode > 0 && out.count != strlen(expected)))) r = 1;
+        if (mode > 0 && jsb.buffer.count != 0) r = 1;
+        jsb_free(&jsb);
+        da_free(&out);
+    }
+    if (r) {
+        log(ERROR, "JSB ndjson test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void *test_jsb_pool_worker(void *arg) {
+    Jsb *jsb = jsb_pool_acquire(64);
+    *(int *)arg = !jsb || jsb_begin_array(jsb) || jsb_end_array(jsb);
+    jsb_pool_release(jsb, NULL);
+    return NULL;
+}
+
+int test_jsb_pool() {
+    log_info("Testing JSB reset and pool...\n");
+    int r = 0;
+    Jsb jsb = {0};
+    LOG_TEST jsb_begin_array(&jsb);
+    for (int i = 0; i < 100; ++i)
+        LOG_TEST jsb_int(&jsb, i);
+    LOG_TEST jsb_end_array(&jsb);
+    size_t capacity = jsb.buffer.capacity;
+    jsb_reset(&jsb);
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_end_array(&jsb);
+    if (jsb.buffer.capacity != capacity || strcmp(jsb_get(&jsb), "[]") != 0) r = 1;
+    jsb_free(&jsb);
+
+    size_t size_hint = 0;
+    for (int round = 0; round < 3 && !r; ++round) {
+        Jsb *pooled = jsb_pool_acquire(size_hint);
+        if (!pooled) {
+            r = 1;
+            break;
+        }
+        // After the first round the buffer is large enough from the start
+        if (round > 0 && pooled->buffer.capacity < size_hint) r = 1;
+        char *first = pooled->buffer.items;
+        pooled->pp = 2;
+        LOG_TEST jsb_begin_object(pooled);
+        LOG_TEST jsb_key(pooled, "message");
+        LOG_TEST jsb_string(pooled, "a string long enough to need a few reallocations");
+        LOG_TEST jsb_end_object(pooled);
+        if (round > 0 && pooled->buffer.items != first) r = 1;
+        // The output buffer is handed over, not copied
+        char *out = jsb_pool_take(pooled, &size_hint);
+        if (round > 0 && out != first) r = 1;
+        if (!out || strcmp(out, "\n{\n  \"message\": \"a string long enough to need a few reallocations\"\n}") != 0) r = 1;
+        if (round == 0) log_info("JSB: %s\n", out);
+        free(out);
+    }
+    jsb_pool_free();
+    // Builders pooled by a thread are freed when it exits
+    pthread_t thread;
+    int err = 1;
+    if (pthread_create(&thread, NULL, test_jsb_pool_worker, &err) == 0) pthread_join(thread, NULL);
+    r = r || err;
+    if (r) {
+        log(ERROR, "JSB pool test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_gzip() {
+    log_info("Testing JSB gzip sink...\n");
+    int r = 0;
+    StringBuilder gzipped = {0};
+    JsbGzip gz;
+    LOG_TEST jsb_gzip_init(&gz, 6, test_jsb_collect, &gzipped);
+    Jsb plain = {.ndjson = true}, jsb = {.ndjson = true};
+    jsb_init_sink(&jsb, jsb_gzip_write, &gz, 256);
+    for (int i = 0; i < 1000; ++i) {
+        for (int k = 0; k < 2; ++k) {
+            Jsb *b = k ? &plain : &jsb;
+            LOG_TEST jsb_begin_object(b);
+            LOG_TEST jsb_key(b, "id");
+            LOG_TEST jsb_int(b, i);
+            LOG_TEST jsb_key(b, "name");
+            LOG_TEST jsb_string(b, "compressible");
+            LOG_TEST jsb_end_object(b);
+        }
+    }
+    LOG_TEST jsb_flush(&jsb);
+    LOG_TEST jsb_gzip_finish(&gz);
+
+    // Inflate and compare
+    z_stream zs = {0};
+    size_t expected = plain.buffer.count;
+    char *out = malloc(expected + 1);
+    if (!r && inflateInit2(&zs, 15 + 16) == Z_OK) {
+        zs.next_in = (Bytef *)gzipped.items;
+        zs.avail_in = (uInt)gzipped.count;
+        zs.next_out = (Bytef *)out;
+        zs.avail_out = (uInt)expected + 1;
+        if (inflate(&zs, Z_FINISH) != Z_STREAM_END || zs.total_out != expected) r = 1;
+        inflateEnd(&zs);
+    } else r = 1;
+    if (!r && memcmp(out, jsb_get(&plain), expected) != 0) r = 1;
+    log_info("JSB: %zu bytes, %zu gzipped\n", expected, gzipped.count);
+    free(out);
+    jsb_free(&plain);
+    jsb_free(&jsb);
+    da_free(&gzipped);
+    if (r) {
+        log(ERROR, "JSB gzip test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_chain() {
+    log_info("Testing JSB segment chain...\n");
+    int r = 0;
+    JsbChain chain = {.segment_size = 100};
+    Jsb plain = {.pp = 2}, jsb = {.pp = 2};
+    jsb_init_sink(&jsb, jsb_chain_write, &chain, 64);
+    for (int k = 0; k < 2; ++k) {
+        Jsb *b = k ? &plain : &jsb;
+        LOG_TEST jsb_begin_array(b);
+        for (int i = 0; i < 200; ++i) {
+            LOG_TEST jsb_int(b, i);
+            LOG_TEST jsb_string(b, "segment");
+        }
+        LOG_TEST jsb_end_array(b);
+    }
+    LOG_TEST jsb_flush(&jsb);
+    char *flat = jsb_chain_flatten(&chain);
+    if (!r && (!flat || strcmp(flat, jsb_get(&plain)) != 0 || chain.total != plain.buffer.count)) r = 1;
+
+    struct iovec iov[64];
+    size_t n = jsb_chain_iov(&chain, iov, 64), total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (iov[i].iov_len > 100) r = 1;
+        total += iov[i].iov_len;
+    }
+    if (total != chain.total) r = 1;
+
+    // Read back in odd-sized pieces like a curl read callback
+    char piece[37];
+    size_t got, off = 0;
+    while (!r && (got = jsb_chain_read(piece, 1, sizeof(piece), &chain)) > 0) {
+        if (memcmp(piece, flat + off, got) != 0) r = 1;
+        off += got;
+    }
+    if (off != chain.total) r = 1;
+    log_info("JSB: %zu bytes in %zu segments\n", chain.total, n);
+    free(flat);
+    jsb_chain_free(&chain);
+    jsb_free(&plain);
+    jsb_free(&jsb);
+    if (r) {
+        log(ERROR, "JSB chain test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_mpb() {
+    log_info("Testing MPB builder...\n");
+    int r = 0;
+    Mpb mpb = {0};
+    LOG_TEST mpb_begin_object(&mpb);
+    LOG_TEST mpb_key(&mpb, "id");
+    LOG_TEST mpb_int(&mpb, 1);
+    LOG_TEST mpb_key(&mpb, "name");
+    LOG_TEST mpb_string(&mpb, "Bob");
+    LOG_TEST mpb_key(&mpb, "tags");
+    LOG_TEST mpb_begin_array(&mpb);
+    LOG_TEST mpb_int(&mpb, -1);
+    LOG_TEST mpb_int(&mpb, -200);
+    LOG_TEST mpb_int(&mpb, 300);
+    LOG_TEST mpb_bool(&mpb, true);
+    LOG_TEST mpb_null(&mpb);
+    LOG_TEST mpb_end_array(&mpb);
+    LOG_TEST mpb_key(&mpb, "big");
+    LOG_TEST mpb_uint64(&mpb, 1ULL << 40);
+    LOG_TEST mpb_key(&mpb, "pi");
+    LOG_TEST mpb_double(&mpb, 1.5);
+    LOG_TEST mpb_key(&mpb, "many");
+    LOG_TEST mpb_begin_array(&mpb);
+    for (int i = 0; i < 20; ++i)
+        LOG_TEST mpb_int(&mpb, i);
+    LOG_TEST mpb_end_array(&mpb);
+    LOG_TEST mpb_end_object(&mpb);
+    // A value without a key is rejected
+    if (mpb_int(&mpb, 1) == 0) r = 1;
+
+    const unsigned char expected[] = {
+        0x86,
+        0xa2, 'i', 'd', 0x01,
+        0xa4, 'n', 'a', 'm', 'e', 0xa3, 'B', 'o', 'b',
+        0xa4, 't', 'a', 'g', 's', 0x95, 0xff, 0xd1, 0xff, 0x38, 0xcd, 0x01, 0x2c, 0xc3, 0xc0,
+        0xa3, 'b', 'i', 'g', 0xcf, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xa2, 'p', 'i', 0xcb, 0x3f, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xa4, 'm', 'a', 'n', 'y', 0xdc, 0x00, 0x14,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19};
+    log_info("MPB: %zu bytes\n", mpb_len(&mpb));
+    if (mpb_len(&mpb) != sizeof(expected) || memcmp(mpb_get(&mpb), expected, sizeof(expected)) != 0) r = 1;
+    mpb_free(&mpb);
+    if (r) {
+        log(ERROR, "MPB builder test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_mpp() {
+    log_info("Testing MPP parser...\n");
+    int r = 0;
+    Mpb mpb = {0};
+    LOG_TEST mpb_begin_object(&mpb);
+    LOG_TEST mpb_key(&mpb, "name");
+    LOG_TEST mpb_string(&mpb, "John");
+    LOG_TEST mpb_key(&mpb, "skipped");
+    LOG_TEST mpb_begin_array(&mpb);
+    for (int i = 0; i < 20; ++i) {
+        LOG_TEST mpb_begin_object(&mpb);
+        LOG_TEST mpb_key(&mpb, "i");
+        LOG_TEST mpb_int(&mpb, i);
+        LOG_TEST mpb_end_object(&mpb);
+    }
+    LOG_TEST mpb_end_array(&mpb);
+    LOG_TEST mpb_key(&mpb, "values");
+    LOG_TEST mpb_begin_array(&mpb);
+    LOG_TEST mpb_int(&mpb, -200);
+    LOG_TEST mpb_uint64(&mpb, UINT64_MAX);
+    LOG_TEST mpb_double(&mpb, 2.5);
+    LOG_TEST mpb_bool(&mpb, true);
+    LOG_TEST mpb_null(&mpb);
+    LOG_TEST mpb_timestamp(&mpb, 1700000000, 500);
+    LOG_TEST mpb_end_array(&mpb);
+    LOG_TEST mpb_end_object(&mpb);
+
+    Mpp mpp = {0};
+    int values = 0;
+    LOG_TEST mpp_init(&mpp, mpb_get(&mpb), mpb_len(&mpb));
+    LOG_TEST mpp_begin_object(&mpp);
+    while (!r && mpp_key(&mpp) == 0) {
+        if (mpp_key_eq(&mpp, "name")) {
+            LOG_TEST mpp_value(&mpp);
+            if (mpp.type != JSP_TYPE_STRING || mpp.string_len != 4 || memcmp(mpp.string, "John", 4) != 0) r = 1;
+        } else if (mpp_key_eq(&mpp, "values")) {
+            LOG_TEST mpp_begin_array(&mpp);
+            if (mpp_array_length(&mpp) != 6) r = 1;
+            while (mpp_value(&mpp) == 0)
+                values++;
+            LOG_TEST mpp_end_array(&mpp);
+        } else {
+            LOG_TEST mpp_skip(&mpp);
+        }
+    }
+    LOG_TEST mpp_end_object(&mpp);
+    if (values != 6 || mpp.type != JSP_TYPE_NUMBER || mpp.integer != 1700000000 || mpp.nsec != 500) r = 1;
+    if (mpp.off != mpb_len(&mpb)) r = 1;
+
+    // Check the scalar decoding
+    LOG_TEST mpp_init(&mpp, mpb_get(&mpb), mpb_len(&mpb));
+    LOG_TEST mpp_begin_object(&mpp);
+    for (int i = 0; i < 2; ++i) {
+        LOG_TEST mpp_key(&mpp);
+        LOG_TEST mpp_skip(&mpp);
+    }
+    LOG_TEST mpp_key(&mpp);
+    LOG_TEST mpp_begin_array(&mpp);
+    LOG_TEST mpp_value(&mpp);
+    if (mpp.integer != -200 || mpp.number != -200) r = 1;
+    LOG_TEST mpp_value(&mpp);
+    if (mpp.uinteger != UINT64_MAX) r = 1;
+    LOG_TEST mpp_value(&mpp);
+    if (mpp.number != 2.5) r = 1;
+    LOG_TEST mpp_value(&mpp);
+    if (mpp.type != JSP_TYPE_BOOLEAN || !mpp.boolean) r = 1;
+    LOG_TEST mpp_value(&mpp);
+    if (mpp.type != JSP_TYPE_NULL) r = 1;
+
+    // Truncated input fails instead of reading past the end
+    LOG_TEST mpp_init(&mpp, mpb_get(&mpb), 10);
+    LOG_TEST mpp_begin_object(&mpp);
+    LOG_TEST mpp_key(&mpp);
+    if (mpp_value(&mpp) == 0) r = 1;
+    mpb_free(&mpb);
+    if (r) {
+        log(ERROR, "MPP parser test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_base64() {
+    log_info("Testing base64 fields...\n");
+    int r = 0;
+    unsigned char data[200];
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 37 + 11);
+    Jsb jsb = {0};
+    LOG_TEST jsb_begin_array(&jsb);
+    LOG_TEST jsb_base64(&jsb, "Man", 3);
+    LOG_TEST jsb_base64(&jsb, "Ma", 2);
+    LOG_TEST jsb_base64(&jsb, "M", 1);
+    LOG_TEST jsb_base64(&jsb, "", 0);
+    LOG_TEST jsb_end_array(&jsb);
+    log_info("JSB: %s\n", jsb_get(&jsb));
+    if (strcmp(jsb_get(&jsb), "[\"TWFu\",\"TWE=\",\"TQ==\",\"\"]") != 0) r = 1;
+
+    // Every length around the vector block sizes
+    LOG_TEST jsb_begin_array(&jsb);
+    for (size_t n = 0; n <= sizeof(data); ++n)
+        LOG_TEST jsb_base64(&jsb, data, n);
+    LOG_TEST jsb_end_array(&jsb);
+    Jsp jsp = {0};
+    unsigned char out[sizeof(data)];
+    LOG_TEST jsp_sinit(&jsp, jsb_get(&jsb));
+    LOG_TEST jsp_begin_array(&jsp);
+    for (size_t n = 0; n <= sizeof(data) && !r; ++n) {
+        size_t len;
+        // Sizing probe, empty values included: not consumed
+        if (jsp_value_base64(&jsp, NULL, 0, &len) || len != n) r = 1;
+        // Too small: not consumed, needed size reported
+        if (n > 0 && (jsp_value_base64(&jsp, out, n - 1, &len) == 0 || len != n)) r = 1;
+        LOG_TEST jsp_value_base64(&jsp, out, sizeof(out), &len);
+        if (len != n || memcmp(out, data, n) != 0) r = 1;
+    }
+    LOG_TEST jsp_end_array(&jsp);
+    jsb_free(&jsb);
+
+    // Escaped slash, missing padding, invalid characters and padding
+    const char *json = "[\"P\\/8=\", \"P/8\", \"P!8=\", \"P/8===\"]";
+    size_t len;
+    LOG_TEST jsp_sinit(&jsp, json);
+    LOG_TEST jsp_begin_array(&jsp);
+    LOG_TEST jsp_value_base64(&jsp, out, sizeof(out), &len);
+    if (len != 2 || out[0] != 0x3f || out[1] != 0xff) r = 1;
+    LOG_TEST jsp_value_base64(&jsp, out, sizeof(out), &len);
+    if (len != 2 || out[0] != 0x3f || out[1] != 0xff) r = 1;
+    if (jsp_value_base64(&jsp, out, sizeof(out), &len) == 0) r = 1;
+    LOG_TEST jsp_value(&jsp);
+    if (jsp_value_base64(&jsp, out, sizeof(out), &len) == 0) r = 1;
+    jsp_free(&jsp);
+    if (r) {
+        log(ERROR, "Base64 test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_jsb_rollback() {
+    log_info("Testing JSB mark and rollback...\n");
+    int r = 0;
+    for (int pp = 0; pp <= 2 && !r; pp += 2) {
+        Jsb jsb = {.pp = pp}, expected = {.pp = pp};
+        LOG_TEST jsb_begin_object(&jsb);
+        // Dropped as the first entry: the next key must not get a comma
+        JsbMark mark = jsb_mark(&jsb);
+        LOG_TEST jsb_key(&jsb, "errors");
+        LOG_TEST jsb_begin_array(&jsb);
+        LOG_TEST jsb_begin_object(&jsb);
+        LOG_TEST jsb_key(&jsb, "code");
+        LOG_TEST jsb_int(&jsb, 1);
+        LOG_TEST jsb_rollback(&jsb, mark);
+        LOG_TEST jsb_key(&jsb, "id");
+        LOG_TEST jsb_int(&jsb, 1);
+        // Kept
+        mark = jsb_mark(&jsb);
+        LOG_TEST jsb_key(&jsb, "tags");
+        LOG_TEST jsb_begin_array(&jsb);
+        LOG_TEST jsb_string(&jsb, "a");
+        LOG_TEST jsb_end_array(&jsb);
+        // Dropped after other entries
+        mark = jsb_mark(&jsb);
+        LOG_TEST jsb_key(&jsb, "empty");
+        LOG_TEST jsb_null(&jsb);
+        LOG_TEST jsb_rollback(&jsb, mark);
+        LOG_TEST jsb_end_object(&jsb);
+
+        LOG_TEST jsb_begin_object(&expected);
+        LOG_TEST jsb_key(&expected, "id");
+        LOG_TEST jsb_int(&expected, 1);
+        LOG_TEST jsb_key(&expected, "tags");
+        LOG_TEST jsb_begin_array(&expected);
+        LOG_TEST jsb_string(&expected, "a");
+        LOG_TEST jsb_end_array(&expected);
+        LOG_TEST jsb_end_object(&expected);
+        if (!r && strcmp(jsb_get(&jsb), jsb_get(&expected)) != 0) r = 1;
+        if (pp == 0) log_info("JSB: %s\n", jsb_get(&jsb));
+        jsb_free(&jsb);
+        jsb_free(&expected);
+    }
+    if (r) {
+        log(ERROR, "JSB rollback test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_jsb_canonical_doc(Jsb *jsb, bool reversed) {
+    int r = 0;
+    LOG_TEST jsb_begin_object(jsb);
+    if (reversed) {
+        LOG_TEST jsb_key(jsb, "b");
+        LOG_TEST jsb_int(jsb, 1);
+    }
+    LOG_TEST jsb_key_tok(jsb, JSB_KEY("a"));
+    LOG_TEST jsb_begin_object(jsb);
+    LOG_TEST jsb_key(jsb, reversed ? "z" : "c");
+    if (reversed) {
+        LOG_TEST jsb_begin_array(jsb);
+        LOG_TEST jsb_int(jsb, 1);
+        LOG_TEST jsb_number(jsb, 2.50, 2);
+        LOG_TEST jsb_begin_object(jsb);
+        LOG_TEST jsb_key(jsb, "y");
+        LOG_TEST jsb_bool(jsb, true);
+        LOG_TEST jsb_key(jsb, "x");
+        LOG_TEST jsb_null(jsb);
+        LOG_TEST jsb_end_object(jsb);
+        LOG_TEST jsb_end_array(jsb);
+        LOG_TEST jsb_key(jsb, "c");
+        LOG_TEST jsb_string(jsb, "s");
+    } else {
+        LOG_TEST jsb_string(jsb, "s");
+        LOG_TEST jsb_key(jsb, "z");
+        LOG_TEST jsb_begin_array(jsb);
+        LOG_TEST jsb_int(jsb, 1);
+        LOG_TEST jsb_double(jsb, 2.5);
+        LOG_TEST jsb_begin_object(jsb);
+        LOG_TEST jsb_key(jsb, "x");
+        LOG_TEST jsb_null(jsb);
+        LOG_TEST jsb_key(jsb, "y");
+        LOG_TEST jsb_bool(jsb, true);
+        LOG_TEST jsb_end_object(jsb);
+        LOG_TEST jsb_end_array(jsb);
+    }
+    LOG_TEST jsb_end_object(jsb);
+    if (!reversed) {
+        LOG_TEST jsb_key(jsb, "b");
+        LOG_TEST jsb_int(jsb, 1);
+    }
+    LOG_TEST jsb_end_object(jsb);
+    return r;
+}
+
+int test_jsb_canonical() {
+    log_info("Testing JSB canonical output and hash...\n");
+    int r = 0;
+    const char *expected = "{\"a\":{\"c\":\"s\",\"z\":[1,2.5,{\"x\":null,\"y\":true}]},\"b\":1}";
+    // XXH64 reference values
+    JsbHash h;
+    jsb_hash_init(&h, 0);
+    if (jsb_hash_final(&h) != 0xEF46DB3751D8E999ULL) r = 1;
+    jsb_hash_update(&h, "abc", 3);
+    if (jsb_hash_final(&h) != 0x44BC2CF5AD770999ULL) r = 1;
+    const char *text = "Nobody inspects the spammish repetition";
+    jsb_hash_init(&h, 0);
+    for (const char *p = text; *p; ++p)
+        jsb_hash_update(&h, p, 1);
+    if (jsb_hash_final(&h) != 0xFBCEA83C8A378BF1ULL) r = 1;
+
+    Jsb a = {.pp = 2, .canonical = true}, b = {.canonical = true};
+    LOG_TEST test_jsb_canonical_doc(&a, false);
+    LOG_TEST test_jsb_canonical_doc(&b, true);
+    jsb_hash_init(&h, 0);
+    jsb_hash_update(&h, expected, strlen(expected));
+    if (!r && (strcmp(jsb_get(&a), expected) != 0 || strcmp(jsb_get(&b), expected) != 0)) r = 1;
+    if (!r && (jsb_hash(&a) != jsb_hash(&b) || jsb_hash(&a) != jsb_hash_final(&h))) r = 1;
+    if (!r) log_info("JSB: %s XXH64: %016llx\n", jsb_get(&b), (unsigned long long)jsb_hash(&b));
+
+    // Rolled back entries are not sorted into the object, hashed elements are hashed again
+    jsb_reset(&b);
+    LOG_TEST jsb_begin_array(&b);
+    LOG_TEST jsb_int(&b, 1);
+    LOG_TEST jsb_begin_array(&b);
+    LOG_TEST jsb_end_array(&b);
+    JsbMark mark = jsb_mark(&b);
+    LOG_TEST jsb_begin_object(&b);
+    LOG_TEST jsb_key(&b, "b");
+    LOG_TEST jsb_int(&b, 2);
+    JsbMark inner = jsb_mark(&b);
+    LOG_TEST jsb_key(&b, "a");
+    LOG_TEST jsb_int(&b, 3);
+    LOG_TEST jsb_rollback(&b, inner);
+    LOG_TEST jsb_end_object(&b);
+    LOG_TEST jsb_rollback(&b, mark);
+    LOG_TEST test_jsb_canonical_doc(&b, true);
+    LOG_TEST jsb_end_array(&b);
+    jsb_hash_init(&h, 0);
+    jsb_hash_update(&h, "[1,[],", 6);
+    jsb_hash_update(&h, expected, strlen(expected));
+    jsb_hash_update(&h, "]", 1);
+    if (!r && jsb_hash(&b) != jsb_hash_final(&h)) r = 1;
+
+    // ndjson records are hashed one by one
+    Jsb nd = {.canonical = true, .ndjson = true};
+    LOG_TEST test_jsb_canonical_doc(&nd, false);
+    uint64_t first = jsb_hash(&nd);
+    LOG_TEST test_jsb_canonical_doc(&nd, true);
+    if (!r && (first != jsb_hash(&a) || jsb_hash(&nd) != first)) r = 1;
+    jsb_free(&a);
+    jsb_free(&b);
+    jsb_free(&nd);
+    if (r) {
+        log(ERROR, "JSB canonical test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_jsb_exact_doc(Jsb *jsb) {
+    int r = 0;
+    LOG_TEST jsb_begin_array(jsb);
+    for (int i = 0; i < 100 && !r; ++i) {
+        LOG_TEST jsb_begin_object(jsb);
+        LOG_TEST jsb_key(jsb, "text");
+        LOG_TEST jsb_string(jsb, "tab\there \"quoted\" caf\xc3\xa9 \xf0\x9f\x98\x80");
+        LOG_TEST jsb_key_tok(jsb, JSB_KEY("numbers"));
+        LOG_TEST jsb_begin_array(jsb);
+        LOG_TEST jsb_int(jsb, -i);
+        LOG_TEST jsb_int64(jsb, INT64_MIN);
+        LOG_TEST jsb_uint64(jsb, UINT64_MAX);
+        LOG_TEST jsb_double(jsb, i / 3.0);
+        LOG_TEST jsb_float(jsb, i * 0.1f);
+        LOG_TEST jsb_number(jsb, i * 1.5, 3);
+        LOG_TEST jsb_end_array(jsb);
+        LOG_TEST jsb_key(jsb, "when");
+        LOG_TEST jsb_datetime_us(jsb, 1700000000123456LL + i);
+        LOG_TEST jsb_key(jsb, "bin");
+        LOG_TEST jsb_base64(jsb, "binary\x01\x02", 8 - i % 3);
+        LOG_TEST jsb_key(jsb, "raw");
+        LOG_TEST jsb_raw(jsb, "{\"k\": [1, 2]}", 13);
+        LOG_TEST jsb_key(jsb, "flag");
+        LOG_TEST jsb_bool(jsb, i % 2);
+        LOG_TEST jsb_key(jsb, "empty");
+        LOG_TEST jsb_begin_object(jsb);
+        LOG_TEST jsb_end_object(jsb);
+        LOG_TEST jsb_key(jsb, "none");
+        LOG_TEST jsb_null(jsb);
+        LOG_TEST jsb_end_object(jsb);
+    }
+    LOG_TEST jsb_end_array(jsb);
+    return r;
+}
+
+int test_jsb_exact() {
+    log_info("Testing JSB counting pass and exact-size output...\n");
+    int r = 0;
+    Jsb modes[] = {{.pp = 0}, {.pp = 2}, {.pp = 4, .ascii = true}, {.canonical = true}};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && !r; ++m) {
+        Jsb expected = modes[m], jsb = modes[m];
+        LOG_TEST test_jsb_exact_doc(&expected);
+        jsb_init_count(&jsb);
+        LOG_TEST test_jsb_exact_doc(&jsb);
+        size_t len = jsb_length(&jsb);
+        // The counting pass never holds the document
+        if (!r && !jsb.canonical && jsb.buffer.capacity > 2 * JSB_COUNT_FLUSH_SIZE) r = 1;
+        if (!r && len != expected.buffer.count) r = 1;
+        char *out = r ? NULL : jsb_init_exact(&jsb, len);
+        if (!out) r = 1;
+        LOG_TEST test_jsb_exact_doc(&jsb);
+        if (!r && (jsb_get(&jsb) != out || strcmp(out, jsb_get(&expected)) != 0)) r = 1;
+        if (m == 0) log_info("JSB: %zu bytes\n", len);
+        jsb_free(&jsb);
+        jsb_free(&expected);
+        free(out);
+    }
+    if (r) {
+        log(ERROR, "JSB exact-size test failed\n");
+        return 1;
+    }
+    return 0;
+}
+
 int test_jsp_j1() {
     StringBuilder sb = {0};
     if (!read_entire_file("tests/json/j1.json", &sb)) {
@@ -829,6 +1938,42 @@ int main() {
     log_info("--------------------------------------------------\n");
     LOG_TEST test_jsb_builder();
     log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_escape();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_integers();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_doubles();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_keys();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_dates();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_fixed_buffer();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_raw_cache();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_parallel();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_ndjson();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_pool();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_gzip();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_chain();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_mpb();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_mpp();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_base64();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_rollback();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_canonical();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_jsb_exact();
+    log_info("--------------------------------------------------\n");
     LOG_TEST test_jsp_j1();
     log_info("--------------------------------------------------\n");
     LOG_TEST test_jsp_j2();
@@ -844,6 +1989,18 @@ int main() {
     LOG_TEST test_patch();
     log_info("--------------------------------------------------\n");
     LOG_TEST test_delete();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_http_client();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_http_batch();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_http_stream();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_http_prealloc();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_http_share();
+    log_info("--------------------------------------------------\n");
+    LOG_TEST test_http2();
 
     da_free(&headers);
     http_cleanup();